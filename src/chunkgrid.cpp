@@ -0,0 +1,156 @@
+#include "chunkgrid.h"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include "log.h"
+#include "tree.h"
+
+ChunkGrid::ChunkGrid(size_t chunkLevels, size_t gridSize, size_t slotNodes, size_t workers):
+    mChunkLevels(chunkLevels),
+    mChunkSize(1uz << chunkLevels),
+    mGridSize(gridSize),
+    mSlotNodes(slotNodes),
+    mSlotLoaded(gridSize * gridSize, false),
+    mSlots(gridSize * gridSize) {
+  assert(gridSize > 0 && slotNodes > 0);
+  // Slots are addressed by 30-bit child pointers from the chunk table on.
+  if (bufferSize() / sizeof(uint32_t) - 1 > Tree::maxNodes) {
+    std::stringstream ss;
+    ss << "Chunk grid needs " << bufferSize() / sizeof(uint32_t) - 1 << " words, exceeding the node limit of ";
+    ss << Tree::maxNodes << ". Reduce the grid size or slot capacity.";
+    Log::fatal(ss.str());
+    std::abort();
+  }
+  for (auto i = 0uz; i < std::max(workers, 1uz); i++)
+    mWorkers.emplace_back([this] { work(); });
+}
+
+ChunkGrid::~ChunkGrid() noexcept {
+  {
+    auto lock = std::unique_lock(mMutex);
+    mStopping = true;
+  }
+  mCondition.notify_all();
+  for (auto& worker: mWorkers)
+    worker.join();
+}
+
+size_t ChunkGrid::wrap(int64_t x) const {
+  auto const n = static_cast<int64_t>(mGridSize);
+  return static_cast<size_t>(((x % n) + n) % n);
+}
+
+void ChunkGrid::init(ShaderStorage& ssbo) {
+  Log::info("Initialising chunk grid...");
+  assert(ssbo.size() >= bufferSize());
+  auto header = std::vector<uint32_t>(1 + tableWords(), 0);
+  header[0] = static_cast<uint32_t>(bufferSize() / sizeof(uint32_t) - 1);
+  ssbo.upload(0, header.size() * sizeof(uint32_t), header.data());
+  std::stringstream ss;
+  ss << mGridSize << "x" << mGridSize << " chunks of size " << mChunkSize << ", ";
+  ss << mSlotNodes << " nodes per slot, " << bufferSize() / 1048576 << " MiB in total.";
+  Log::info(ss.str());
+}
+
+void ChunkGrid::update(double x, double z) {
+  auto const size = static_cast<double>(mChunkSize);
+  auto const half = static_cast<int64_t>(mGridSize / 2);
+  auto const cx = static_cast<int64_t>(std::floor(x / size));
+  auto const cz = static_cast<int64_t>(std::floor(z / size));
+  if (mOriginValid && mOriginX == cx - half && mOriginZ == cz - half)
+    return;
+  mOriginX = cx - half;
+  mOriginZ = cz - half;
+  mOriginValid = true;
+
+  auto lock = std::unique_lock(mMutex);
+  // Reassign slots whose chunks fell behind.
+  for (auto i = 0uz; i < mGridSize; i++) {
+    for (auto j = 0uz; j < mGridSize; j++) {
+      auto const chunkX = mOriginX + static_cast<int64_t>(i);
+      auto const chunkZ = mOriginZ + static_cast<int64_t>(j);
+      auto const index = slotIndex(chunkX, chunkZ);
+      auto& slot = mSlots[index];
+      if (slot.assigned && slot.x == chunkX && slot.z == chunkZ)
+        continue;
+      slot = Slot{chunkX, chunkZ, slot.ticket + 1, true};
+      if (mSlotLoaded[index]) {
+        mSlotLoaded[index] = false;
+        mLoaded--;
+      }
+      mJobs.push_back(Job{index, chunkX, chunkZ, slot.ticket});
+    }
+  }
+  // Drop outdated jobs, then generate chunks closest to the camera first.
+  std::erase_if(mJobs, [this](Job const& job) { return mSlots[job.slot].ticket != job.ticket; });
+  std::ranges::sort(mJobs, {}, [cx, cz](Job const& job) {
+    return std::max(std::abs(job.x - cx), std::abs(job.z - cz));
+  });
+  lock.unlock();
+  mCondition.notify_all();
+}
+
+size_t ChunkGrid::upload(ShaderStorage& ssbo, size_t maxUploads) {
+  auto results = std::vector<Result>();
+  {
+    auto lock = std::unique_lock(mMutex);
+    auto const count = std::min(maxUploads, mResults.size());
+    results.assign(
+      std::make_move_iterator(mResults.begin()),
+      std::make_move_iterator(mResults.begin() + static_cast<ptrdiff_t>(count))
+    );
+    mResults.erase(mResults.begin(), mResults.begin() + static_cast<ptrdiff_t>(count));
+    // Discard results for slots that have been reassigned in the meantime.
+    std::erase_if(results, [this](Result const& res) { return mSlots[res.slot].ticket != res.ticket; });
+  }
+  for (auto const& res: results) {
+    auto const base = slotBase(res.slot);
+    ssbo.upload((1 + base) * sizeof(uint32_t), res.nodes.size() * sizeof(uint32_t), res.nodes.data());
+    auto const entry = std::array<uint32_t, entryWords>{
+      static_cast<uint32_t>(res.x),
+      static_cast<uint32_t>(res.z),
+      static_cast<uint32_t>(base),
+      0,
+    };
+    ssbo.upload((1 + res.slot * entryWords) * sizeof(uint32_t), sizeof(entry), entry.data());
+    if (!mSlotLoaded[res.slot]) {
+      mSlotLoaded[res.slot] = true;
+      mLoaded++;
+    }
+  }
+  return results.size();
+}
+
+void ChunkGrid::work() {
+  while (true) {
+    auto job = Job();
+    {
+      auto lock = std::unique_lock(mMutex);
+      mCondition.wait(lock, [this] { return mStopping || !mJobs.empty(); });
+      if (mStopping)
+        return;
+      job = mJobs.front();
+      mJobs.pop_front();
+      if (mSlots[job.slot].ticket != job.ticket)
+        continue;
+    }
+
+    auto const size = static_cast<int64_t>(mChunkSize);
+    auto tree = Tree(mChunkSize, mChunkSize, job.x * size, 0, job.z * size);
+    tree.generate(false);
+    auto nodes = tree.exportNodes(static_cast<uint32_t>(slotBase(job.slot)));
+    if (nodes.size() > mSlotNodes) {
+      std::stringstream ss;
+      ss << "Chunk (" << job.x << ", " << job.z << ") needs " << nodes.size() << " nodes, ";
+      ss << "exceeding slot capacity " << mSlotNodes << ". Leaving it empty.";
+      Log::warning(ss.str());
+      nodes = {3u}; // Empty leaf.
+    }
+
+    auto lock = std::unique_lock(mMutex);
+    mResults.push_back(Result{job.slot, job.x, job.z, job.ticket, std::move(nodes)});
+  }
+}
@@ -0,0 +1,94 @@
+#ifndef CHUNKGRID_H_
+#define CHUNKGRID_H_
+
+#include <concepts>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "shaderstorage.h"
+
+// A camera-centred toroidal grid of chunk subtrees (infinite mode).
+// Chunks are generated on worker threads and uploaded into fixed-size slots of the tree buffer:
+//   [NodeCount] [chunk table: `gridSize * gridSize` entries] [slot 0] [slot 1] ...
+// Chunk `(x, z)` always maps to slot `(x mod gridSize) + (z mod gridSize) * gridSize`, so retiring a chunk
+// only means overwriting its slot; stale table entries are rejected by the shader via their coordinates.
+class ChunkGrid {
+public:
+  // Words per chunk table entry: chunk x, chunk z, root pointer (0 = not loaded), padding.
+  static constexpr size_t entryWords = 4;
+
+  ChunkGrid(size_t chunkLevels, size_t gridSize, size_t slotNodes, size_t workers);
+  ~ChunkGrid() noexcept;
+
+  ChunkGrid(ChunkGrid const&) = delete;
+  ChunkGrid& operator=(ChunkGrid const&) = delete;
+
+  size_t chunkSize() const { return mChunkSize; }
+  size_t gridSize() const { return mGridSize; }
+  int64_t originX() const { return mOriginX; }
+  int64_t originZ() const { return mOriginZ; }
+  size_t originSlotX() const { return wrap(mOriginX); }
+  size_t originSlotZ() const { return wrap(mOriginZ); }
+  size_t loaded() const { return mLoaded; }
+  size_t bufferSize() const { return (1 + tableWords() + mGridSize * mGridSize * mSlotNodes) * sizeof(uint32_t); }
+
+  // Writes the buffer header and an empty chunk table.
+  void init(ShaderStorage& ssbo);
+
+  // Moves the grid to be centred at the given position, requesting new chunks and retiring old ones.
+  void update(double x, double z);
+
+  // Uploads at most `maxUploads` finished chunks. Never waits for workers.
+  size_t upload(ShaderStorage& ssbo, size_t maxUploads);
+
+private:
+  struct Slot {
+    int64_t x = 0, z = 0;
+    uint64_t ticket = 0; // Incremented whenever the slot is reassigned.
+    bool assigned = false;
+  };
+
+  struct Job {
+    size_t slot;
+    int64_t x, z;
+    uint64_t ticket;
+  };
+
+  struct Result {
+    size_t slot;
+    int64_t x, z;
+    uint64_t ticket;
+    std::vector<uint32_t> nodes;
+  };
+
+  size_t mChunkLevels, mChunkSize, mGridSize, mSlotNodes;
+  int64_t mOriginX = 0, mOriginZ = 0;
+  bool mOriginValid = false;
+  size_t mLoaded = 0;
+
+  // Accessed by main thread only.
+  std::vector<bool> mSlotLoaded;
+
+  // Shared with workers (guarded by `mMutex`).
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  std::vector<Slot> mSlots;
+  std::deque<Job> mJobs;
+  std::vector<Result> mResults;
+  bool mStopping = false;
+
+  std::vector<std::thread> mWorkers;
+
+  size_t tableWords() const { return mGridSize * mGridSize * entryWords; }
+  size_t slotBase(size_t slot) const { return tableWords() + slot * mSlotNodes; }
+  size_t wrap(int64_t x) const;
+  size_t slotIndex(int64_t x, int64_t z) const { return wrap(x) + wrap(z) * mGridSize; }
+  void work();
+};
+
+static_assert(!std::move_constructible<ChunkGrid>);
+
+#endif // CHUNKGRID_H_
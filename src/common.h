@@ -51,6 +51,9 @@ inline auto configPath() -> std::string {
 inline auto shaderPath() -> std::string {
   return "./shaders/";
 };
+inline auto shaderCachePath() -> std::string {
+  return "./shadercache/";
+}
 inline auto screenshotPath() -> std::string {
   return "./screenshots/";
 }
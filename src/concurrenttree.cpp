@@ -0,0 +1,304 @@
+#include "concurrenttree.h"
+#include <cassert>
+#include <random>
+#include <sstream>
+#include <thread>
+#include "log.h"
+#include "tree.h"
+#include "updatescheduler.h"
+#include "worldgen.h"
+
+namespace {
+  // Same encoding as `main.csh`.
+  constexpr uint32_t unvisited = 0u, locked = 1u;
+  constexpr bool isLeaf(uint32_t data) { return (data & 3u) == 3u; }
+  constexpr uint32_t childPtr(uint32_t data) { return data >> 2u; }
+  constexpr uint32_t leafData(uint32_t data) { return data >> 2u; }
+  constexpr uint32_t makeIntermediate(uint32_t ind) { return (ind << 2u) + 1u; }
+  constexpr uint32_t makeLeaf(uint32_t data) { return (data << 2u) + 3u; }
+
+  // Number of yields before blocking on a locked slot.
+  constexpr size_t backoffRounds = 6;
+}
+
+ConcurrentTree::ConcurrentTree(size_t levels, size_t height, size_t maxNodes):
+    mLevels(levels),
+    mSize(1uz << levels),
+    mHeight(height),
+    mMaxNodes(std::min(maxNodes, Tree::maxNodes)),
+    mSlots(new std::atomic<uint32_t>[mMaxNodes]()),
+    mMaxHeight(levels + 1),
+    mMinHeight(levels + 1) {
+  assert(mMaxNodes >= 1);
+  // Build height bounds bottom-up, so that node classification takes constant time.
+  mMaxHeight[levels].resize(mSize * mSize);
+  for (auto x = 0uz; x < mSize; x++)
+    for (auto z = 0uz; z < mSize; z++)
+      mMaxHeight[levels][x * mSize + z] = WorldGen::getHeight(static_cast<double>(x), static_cast<double>(z)) + 64;
+  mMinHeight[levels] = mMaxHeight[levels];
+  for (auto level = levels; level-- > 0;) {
+    auto const n = 1uz << level;
+    mMaxHeight[level].resize(n * n);
+    mMinHeight[level].resize(n * n);
+    for (auto x = 0uz; x < n; x++)
+      for (auto z = 0uz; z < n; z++) {
+        auto const& maxs = mMaxHeight[level + 1];
+        auto const& mins = mMinHeight[level + 1];
+        auto const i = (x * 2) * (n * 2) + z * 2, j = i + n * 2;
+        mMaxHeight[level][x * n + z] = std::max({maxs[i], maxs[i + 1], maxs[j], maxs[j + 1]});
+        mMinHeight[level][x * n + z] = std::min({mins[i], mins[i + 1], mins[j], mins[j + 1]});
+      }
+  }
+}
+
+ConcurrentTree::Stats ConcurrentTree::stats() const {
+  auto res = Stats();
+  res.contended = mContended.load(std::memory_order_relaxed);
+  res.helped = mHelped.load(std::memory_order_relaxed);
+  res.waited = mWaited.load(std::memory_order_relaxed);
+  res.overflows = mOverflows.load(std::memory_order_relaxed);
+  return res;
+}
+
+void ConcurrentTree::clear() {
+  auto const count = nodeCount();
+  for (auto i = 0uz; i < count; i++)
+    mSlots[i].store(unvisited, std::memory_order_relaxed);
+  mNodeCount.store(1, std::memory_order_relaxed);
+  mContended = mHelped = mWaited = mOverflows = 0;
+}
+
+// Mirrors `Tree::generateNode`, so that both produce identical trees.
+uint32_t ConcurrentTree::classify(size_t level, size_t x, size_t y, size_t z) const {
+  auto const size = mSize >> level;
+  auto const y0 = static_cast<int64_t>(y * size), y1 = static_cast<int64_t>((y + 1) * size);
+  auto const n = 1uz << level;
+  if (size > 1 && y0 >= static_cast<int64_t>(mHeight))
+    return makeLeaf(0u);
+  if (mMaxHeight[level][x * n + z] <= y0)
+    return makeLeaf(0u);
+  if (mMinHeight[level][x * n + z] >= y1 && (size == 1 || y1 <= static_cast<int64_t>(mHeight)))
+    return makeLeaf(1u);
+  return 0u;
+}
+
+uint32_t ConcurrentTree::generateNode(size_t level, size_t x, size_t y, size_t z) {
+  if (auto const res = classify(level, x, y, z); res != 0u)
+    return res;
+  // Children of a fresh allocation are already unvisited: slots are zeroed and never reused without `clear()`.
+  auto const res = mNodeCount.fetch_add(8u, std::memory_order_relaxed);
+  if (static_cast<size_t>(res) + 8 > mMaxNodes) {
+    mOverflows.fetch_add(1, std::memory_order_relaxed);
+    auto const n = 1uz << level;
+    auto const mid = (mMaxHeight[level][x * n + z] + mMinHeight[level][x * n + z]) / 2;
+    return makeLeaf(mid > static_cast<int64_t>((y * 2 + 1) * (mSize >> level) / 2) ? 1u : 0u);
+  }
+  return makeIntermediate(res);
+}
+
+// Returns node at `ptr`, generating it if needed.
+uint32_t ConcurrentTree::getNode(uint32_t ptr, size_t level, size_t x, size_t y, size_t z) {
+  auto& slot = mSlots[ptr];
+  auto data = slot.load(std::memory_order_acquire);
+  if (data == unvisited) {
+    if (slot.compare_exchange_strong(data, locked, std::memory_order_acquire)) {
+      data = generateNode(level, x, y, z);
+      slot.store(data, std::memory_order_release);
+      slot.notify_all();
+      return data;
+    }
+  }
+  if (data == locked)
+    data = waitNode(slot, level, x, y, z);
+  return data;
+}
+
+// Resolves a slot locked by another thread.
+uint32_t ConcurrentTree::waitNode(std::atomic<uint32_t>& slot, size_t level, size_t x, size_t y, size_t z) {
+  mContended.fetch_add(1, std::memory_order_relaxed);
+  // Help: leaves do not depend on the allocation made by the owner. (Overflowed nodes may differ, but are only
+  // approximations in the first place.)
+  if (auto const res = classify(level, x, y, z); res != 0u) {
+    mHelped.fetch_add(1, std::memory_order_relaxed);
+    return res;
+  }
+  // Back off: the owner only has to allocate, so the slot is usually published very soon.
+  for (auto i = 0uz; i < backoffRounds; i++) {
+    for (auto j = 0uz; j < (1uz << i); j++)
+      std::this_thread::yield();
+    if (auto const data = slot.load(std::memory_order_acquire); data != locked) {
+      mHelped.fetch_add(1, std::memory_order_relaxed);
+      return data;
+    }
+  }
+  mWaited.fetch_add(1, std::memory_order_relaxed);
+  auto data = locked;
+  while ((data = slot.load(std::memory_order_acquire)) == locked)
+    slot.wait(locked, std::memory_order_acquire);
+  return data;
+}
+
+uint32_t ConcurrentTree::get(size_t x, size_t y, size_t z) {
+  assert(x < mSize && y < mSize && z < mSize);
+  auto ptr = 0u;
+  for (auto level = 0uz;; level++) {
+    auto const shift = mLevels - level;
+    auto const data = getNode(ptr, level, x >> shift, y >> shift, z >> shift);
+    if (isLeaf(data))
+      return leafData(data);
+    assert(shift > 0);
+    auto const half = 1uz << (shift - 1);
+    ptr = childPtr(data) + ((x & half) ? 1u : 0u) + ((y & half) ? 2u : 0u) + ((z & half) ? 4u : 0u);
+  }
+}
+
+void ConcurrentTree::expand(size_t seed) {
+  expandNode(0u, 0, 0, 0, 0, seed);
+}
+
+void ConcurrentTree::expandNode(uint32_t ptr, size_t level, size_t x, size_t y, size_t z, size_t seed) {
+  auto const data = getNode(ptr, level, x, y, z);
+  if (isLeaf(data))
+    return;
+  for (auto j = 0u; j < 8u; j++) {
+    auto const i = (j + static_cast<uint32_t>(seed)) % 8u;
+    auto const cx = x * 2 + (i & 1u), cy = y * 2 + ((i >> 1) & 1u), cz = z * 2 + ((i >> 2) & 1u);
+    expandNode(childPtr(data) + i, level + 1, cx, cy, cz, seed * 3 + 1);
+  }
+}
+
+size_t ConcurrentTree::reachable() const {
+  auto res = 0uz;
+  auto stack = std::vector<uint32_t>{0u};
+  while (!stack.empty()) {
+    auto const data = mSlots[stack.back()].load(std::memory_order_relaxed);
+    stack.pop_back();
+    if (data == unvisited || data == locked)
+      continue;
+    res++;
+    if (!isLeaf(data))
+      for (auto i = 0u; i < 8u; i++)
+        stack.push_back(childPtr(data) + i);
+  }
+  return res;
+}
+
+bool ConcurrentTree::stressTest(size_t levels, size_t threads, size_t queries) {
+  std::stringstream ss;
+  ss << "Stress testing concurrent tree (" << levels << " levels, " << threads << " threads)...";
+  Log::info(ss.str());
+
+  auto const size = 1uz << levels;
+  auto reference = Tree(size, size);
+  reference.generate(false);
+  auto const& nodes = reference.nodes();
+  auto const expected = [&](size_t x, size_t y, size_t z) {
+    auto ind = 0uz;
+    for (auto half = size / 2; !nodes[ind].leaf; half /= 2)
+      ind = nodes[ind].data + ((x & half) ? 1 : 0) + ((y & half) ? 2 : 0) + ((z & half) ? 4 : 0);
+    return static_cast<uint32_t>(nodes[ind].data);
+  };
+
+  auto tree = ConcurrentTree(levels, size, nodes.size() * 2);
+  auto ok = true;
+
+  // Phase 1: all threads query the same points (in different orders) while the tree is being generated.
+  auto rng = std::mt19937(2333);
+  auto points = std::vector<size_t>(queries * 3);
+  for (auto& p: points)
+    p = rng() % size;
+  auto results = std::vector<std::vector<uint32_t>>(threads, std::vector<uint32_t>(queries));
+  {
+    auto workers = std::vector<std::jthread>();
+    for (auto t = 0uz; t < threads; t++)
+      workers.emplace_back([&, t] {
+        for (auto k = 0uz; k < queries; k++) {
+          auto const i = (k + t * queries / threads) % queries;
+          results[t][i] = tree.get(points[i * 3], points[i * 3 + 1], points[i * 3 + 2]);
+        }
+      });
+  }
+  auto mismatches = 0uz;
+  for (auto i = 0uz; i < queries; i++) {
+    auto const value = expected(points[i * 3], points[i * 3 + 1], points[i * 3 + 2]);
+    for (auto t = 0uz; t < threads; t++)
+      if (results[t][i] != value)
+        mismatches++;
+  }
+  if (mismatches > 0) {
+    ss.str("");
+    ss << mismatches << " of " << queries * threads << " queries returned wrong blocks.";
+    Log::error(ss.str());
+    ok = false;
+  }
+
+  // Phase 2: all threads expand the whole tree simultaneously.
+  {
+    auto workers = std::vector<std::jthread>();
+    for (auto t = 0uz; t < threads; t++)
+      workers.emplace_back([&, t] { tree.expand(t); });
+  }
+  auto const count = tree.reachable();
+  if (count != nodes.size()) {
+    ss.str("");
+    ss << "Fully expanded tree has " << count << " reachable nodes, expected " << nodes.size() << ".";
+    Log::error(ss.str());
+    ok = false;
+  }
+  for (auto i = 0uz; i < tree.nodeCount(); i++)
+    if (tree.mSlots[i].load(std::memory_order_relaxed) == locked) {
+      Log::error("Locked slot left behind.");
+      ok = false;
+      break;
+    }
+
+  auto const stats = tree.stats();
+  ss.str("");
+  ss << (ok ? "Passed: " : "Failed: ") << count << " nodes, " << stats.contended << " contended slots (";
+  ss << stats.helped << " helped, " << stats.waited << " waited), " << stats.overflows << " overflows.";
+  ok ? Log::info(ss.str()) : Log::error(ss.str());
+  return ok;
+}
+
+void ConcurrentTree::benchmark(size_t levels, size_t maxThreads, size_t queries) {
+  std::stringstream ss;
+  ss << "Benchmarking concurrent tree (" << levels << " levels, " << queries << " queries)...";
+  Log::info(ss.str());
+
+  auto const size = 1uz << levels;
+  auto tree = ConcurrentTree(levels, size, size * size * 16);
+  auto rng = std::mt19937(2333);
+  auto points = std::vector<size_t>(queries * 3);
+  for (auto& p: points)
+    p = rng() % size;
+
+  // Powers of two, then `maxThreads` itself.
+  auto counts = std::vector<size_t>();
+  for (auto threads = 1uz; threads < maxThreads; threads *= 2)
+    counts.push_back(threads);
+  counts.push_back(std::max(maxThreads, 1uz));
+
+  auto baseline = 0.0;
+  for (auto threads: counts) {
+    tree.clear();
+    auto const start = UpdateScheduler::timeFromEpoch();
+    {
+      auto workers = std::vector<std::jthread>();
+      for (auto t = 0uz; t < threads; t++)
+        workers.emplace_back([&, t] {
+          for (auto i = queries * t / threads; i < queries * (t + 1) / threads; i++)
+            tree.get(points[i * 3], points[i * 3 + 1], points[i * 3 + 2]);
+        });
+    }
+    auto const elapsed = UpdateScheduler::timeFromEpoch() - start;
+    if (threads == 1)
+      baseline = elapsed;
+    auto const stats = tree.stats();
+    ss.str("");
+    ss << threads << " threads: " << elapsed << "s, ";
+    ss << static_cast<double>(queries) / elapsed / 1e6 << "M queries/s, ";
+    ss << "speedup " << baseline / elapsed << ", " << tree.nodeCount() << " nodes, ";
+    ss << stats.contended << " contended (" << stats.helped << " helped, " << stats.waited << " waited).";
+    Log::info(ss.str());
+  }
+}
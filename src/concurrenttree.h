@@ -0,0 +1,75 @@
+#ifndef CONCURRENTTREE_H_
+#define CONCURRENTTREE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// A lazily expanded octree on the CPU that many threads can descend and generate concurrently without mutexes.
+// Uses the same slot encoding and protocol as `getNode` in `main.csh`:
+//   0 = unvisited, 1 = locked, `[01]` = intermediate (child pointer), `[11]` = leaf (block data).
+// The first thread to reach an unvisited slot locks it with a CAS, generates it (allocating 8 children by an
+// atomic add if needed) and publishes the result. Other threads reaching a locked slot first try to classify
+// the node themselves (leaves need no allocation, so their result is already known); otherwise they back off
+// and finally block on the slot until it is published.
+class ConcurrentTree {
+public:
+  struct Stats {
+    size_t contended = 0; // Locked slots encountered.
+    size_t helped = 0;    // ...resolved without waiting.
+    size_t waited = 0;    // ...resolved after blocking.
+    size_t overflows = 0; // Allocations failed (the node is approximated by a leaf).
+  };
+
+  ConcurrentTree(size_t levels, size_t height, size_t maxNodes);
+
+  ConcurrentTree(ConcurrentTree const&) = delete;
+  ConcurrentTree& operator=(ConcurrentTree const&) = delete;
+
+  size_t size() const { return mSize; }
+  size_t nodeCount() const { return std::min<size_t>(mNodeCount.load(std::memory_order_relaxed), mMaxNodes); }
+  Stats stats() const;
+
+  // Returns leaf data of the block at the given position, generating nodes on the way. Thread-safe.
+  // Pre: position is inside the root box.
+  uint32_t get(size_t x, size_t y, size_t z);
+
+  // Generates the whole tree. Children are visited in an order rotated by `seed`, so that concurrent callers
+  // with different seeds start in different places and meet each other throughout the tree. Thread-safe.
+  void expand(size_t seed);
+
+  // Returns the number of generated nodes reachable from the root. Not thread-safe.
+  size_t reachable() const;
+
+  // Discards all nodes. Not thread-safe.
+  void clear();
+
+  // Checks results of concurrent generation against `Tree`. Returns `true` on success.
+  static bool stressTest(size_t levels, size_t threads, size_t queries);
+
+  // Measures query throughput on a fresh tree with 1 to `maxThreads` threads.
+  static void benchmark(size_t levels, size_t maxThreads, size_t queries);
+
+private:
+  size_t mLevels, mSize, mHeight, mMaxNodes;
+  std::unique_ptr<std::atomic<uint32_t>[]> mSlots;
+  std::atomic<uint32_t> mNodeCount = 1;
+  std::atomic<size_t> mContended = 0, mHelped = 0, mWaited = 0, mOverflows = 0;
+
+  // Column height bounds of each level (level 0 is the root), indexed by `x * (1 << level) + z`.
+  std::vector<std::vector<int64_t>> mMaxHeight, mMinHeight;
+
+  // Returns the node data if it is a leaf, or 0 otherwise (never allocates).
+  uint32_t classify(size_t level, size_t x, size_t y, size_t z) const;
+  uint32_t generateNode(size_t level, size_t x, size_t y, size_t z);
+  uint32_t getNode(uint32_t ptr, size_t level, size_t x, size_t y, size_t z);
+  uint32_t waitNode(std::atomic<uint32_t>& slot, size_t level, size_t x, size_t y, size_t z);
+  void expandNode(uint32_t ptr, size_t level, size_t x, size_t y, size_t z, size_t seed);
+};
+
+static_assert(!std::move_constructible<ConcurrentTree>);
+
+#endif // CONCURRENTTREE_H_
@@ -32,6 +32,14 @@ public:
     }
   }
 
+  template <typename T>
+  requires StringStreamConvertible<T>
+  void set(std::string const& key, T value) {
+    std::stringstream ss;
+    ss << value;
+    mValues[key] = ss.str();
+  }
+
   void load(std::string const& file);
   void save(std::string const& file);
 
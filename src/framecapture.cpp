@@ -0,0 +1,153 @@
+#include "framecapture.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <filesystem>
+#include <limits>
+#include "bitmap.h"
+#include "log.h"
+
+FrameCapture::FrameCapture(size_t slots, size_t workers):
+    mSlots(std::max(slots, 1uz)) {
+  glGenFramebuffers(1, &mFramebuffer);
+  auto const gamma = 2.2;
+  for (auto i = 0uz; i < mGamma.size(); i++) {
+    auto const col = std::pow(static_cast<double>(i) / 65535.0, 1.0 / gamma);
+    mGamma[i] = static_cast<uint8_t>(std::lround(col * 255.0));
+  }
+  for (auto i = 0uz; i < std::max(workers, 1uz); i++)
+    mWorkers.emplace_back([this] { work(); });
+}
+
+FrameCapture::~FrameCapture() noexcept {
+  // Wait for the readbacks in flight, then for the workers to finish them.
+  for (auto& slot: mSlots)
+    if (slot.fence != nullptr)
+      glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, std::numeric_limits<GLuint64>::max());
+  update();
+  {
+    auto lock = std::unique_lock(mMutex);
+    mCondition.wait(lock, [this] { return mJobs.empty() && mConverting == 0; });
+    mStopping = true;
+  }
+  mCondition.notify_all();
+  for (auto& worker: mWorkers)
+    worker.join();
+  for (auto& slot: mSlots)
+    reallocate(slot, 0);
+  glDeleteFramebuffers(1, &mFramebuffer);
+}
+
+void FrameCapture::reallocate(Slot& slot, size_t size) {
+  if (slot.buffer != OpenGL::null) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, OpenGL::null);
+    glDeleteBuffers(1, &slot.buffer);
+    slot.buffer = OpenGL::null;
+    slot.data = nullptr;
+    slot.capacity = 0;
+  }
+  if (size == 0)
+    return;
+  GLenum flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT;
+  glGenBuffers(1, &slot.buffer);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  glBufferStorage(GL_PIXEL_PACK_BUFFER, size, nullptr, flags);
+  slot.data = static_cast<uint16_t const*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, flags));
+  slot.capacity = size;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, OpenGL::null);
+}
+
+bool FrameCapture::capture(Texture const& texture, size_t width, size_t height, std::string filename, bool retried) {
+  auto it = mSlots.end();
+  {
+    auto lock = std::unique_lock(mMutex);
+    it = std::ranges::find_if(mSlots, [](Slot const& slot) { return slot.state == State::free; });
+    if (it != mSlots.end())
+      it->state = State::reading;
+  }
+  if (it == mSlots.end()) {
+    if (!retried)
+      mDropped++;
+    return false;
+  }
+  auto& slot = *it;
+  auto const size = width * height * 4 * sizeof(uint16_t);
+  if (slot.capacity < size)
+    reallocate(slot, size);
+  slot.width = width;
+  slot.height = height;
+  slot.filename = std::move(filename);
+
+  // Pixels written by compute shaders must be visible to framebuffer reads.
+  glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, mFramebuffer);
+  glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture.handle(), 0);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, static_cast<GLsizei>(width), static_cast<GLsizei>(height), GL_RGBA, GL_UNSIGNED_SHORT, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, OpenGL::null);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, OpenGL::null);
+  glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  return true;
+}
+
+void FrameCapture::update() {
+  auto ready = false;
+  {
+    auto lock = std::unique_lock(mMutex);
+    for (auto i = 0uz; i < mSlots.size(); i++) {
+      auto& slot = mSlots[i];
+      if (slot.state != State::reading || glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        continue;
+      glDeleteSync(slot.fence);
+      slot.fence = nullptr;
+      slot.state = State::converting;
+      mJobs.push_back(i);
+      ready = true;
+    }
+  }
+  if (ready)
+    mCondition.notify_all();
+}
+
+void FrameCapture::work() {
+  while (true) {
+    auto index = 0uz;
+    {
+      auto lock = std::unique_lock(mMutex);
+      mCondition.wait(lock, [this] { return mStopping || !mJobs.empty(); });
+      if (mStopping)
+        return;
+      index = mJobs.front();
+      mJobs.pop_front();
+      mConverting++;
+    }
+
+    // Only this worker accesses a converting slot. Rows are bottom-up in both the buffer and the bitmap.
+    auto const& slot = mSlots[index];
+    auto bmp = Bitmap(slot.width, slot.height, 3);
+    for (auto y = 0uz; y < slot.height; y++) {
+      auto const* src = slot.data + y * slot.width * 4;
+      auto* dst = bmp.data() + y * bmp.pitch();
+      for (auto x = 0uz; x < slot.width; x++, src += 4, dst += 3) {
+        dst[0] = mGamma[src[2]];
+        dst[1] = mGamma[src[1]];
+        dst[2] = mGamma[src[0]];
+      }
+    }
+    auto ec = std::error_code();
+    std::filesystem::create_directories(std::filesystem::path(slot.filename).parent_path(), ec);
+    bmp.save(slot.filename);
+
+    {
+      auto lock = std::unique_lock(mMutex);
+      mSlots[index].state = State::free;
+      mConverting--;
+    }
+    mCondition.notify_all();
+  }
+}
@@ -0,0 +1,71 @@
+#ifndef FRAMECAPTURE_H_
+#define FRAMECAPTURE_H_
+
+#include <array>
+#include <concepts>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "opengl.h"
+#include "texture.h"
+
+// Saves frames without stalling the render thread. Each capture is read into a slot of a ring of persistently-mapped
+// pixel buffers (`glReadPixels` into a pack buffer, then a fence). Once the fence has signalled, a worker converts
+// the 16-bit linear pixels to 8-bit sRGB through a lookup table and writes the bitmap.
+// Captures are dropped while all slots are busy, so continuous capture never slows down rendering.
+class FrameCapture {
+public:
+  FrameCapture(size_t slots, size_t workers);
+  ~FrameCapture() noexcept; // Finishes pending captures.
+
+  FrameCapture(FrameCapture const&) = delete;
+  FrameCapture& operator=(FrameCapture const&) = delete;
+
+  // Frames discarded because all slots were busy (captures the caller retries are not counted).
+  size_t dropped() const { return mDropped; }
+
+  // Starts reading the bottom-left `width * height` pixels of `texture` (linear colour), to be saved to `filename`.
+  // Returns false if all slots are busy; unless `retried`, the frame then counts as dropped.
+  bool capture(Texture const& texture, size_t width, size_t height, std::string filename, bool retried = false);
+
+  // Hands finished readbacks to the workers. Never waits.
+  void update();
+
+private:
+  enum class State { free, reading, converting };
+
+  struct Slot {
+    OpenGL::Object buffer = OpenGL::null;
+    uint16_t const* data = nullptr; // Mapped `buffer`, RGBA.
+    size_t capacity = 0; // In bytes.
+    GLsync fence = nullptr;
+    size_t width = 0, height = 0;
+    std::string filename;
+    State state = State::free; // Guarded by `mMutex`. Other members belong to the worker while converting.
+  };
+
+  OpenGL::Object mFramebuffer = OpenGL::null;
+  std::array<uint8_t, 65536> mGamma; // 16-bit linear to 8-bit sRGB.
+  size_t mDropped = 0;
+
+  // Shared with workers (guarded by `mMutex`).
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  std::vector<Slot> mSlots;
+  std::deque<size_t> mJobs;
+  size_t mConverting = 0;
+  bool mStopping = false;
+
+  std::vector<std::thread> mWorkers;
+
+  void reallocate(Slot& slot, size_t size);
+  void work();
+};
+
+static_assert(!std::move_constructible<FrameCapture>);
+
+#endif // FRAMECAPTURE_H_
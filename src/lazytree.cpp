@@ -0,0 +1,194 @@
+#include "lazytree.h"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <sstream>
+#include "log.h"
+#include "worldgen.h"
+
+// The root of a subtree is stored at this offset in its first block, so that the sibling groups following it
+// (at `1 + 8k` in `Tree`) start at multiples of 8 and never straddle two blocks.
+constexpr auto rootOffset = 7uz;
+
+LazyTree::LazyTree(size_t subtreeLevels, size_t height, size_t maxNodes):
+    mSubtreeLevels(subtreeLevels),
+    mSubtreeSize(1uz << subtreeLevels),
+    mHeight(height) {
+  static_assert(blockNodes % 8 == 0);
+  // Child pointers are 30 bits.
+  auto const blocks = std::min(maxNodes, Tree::maxNodes) / blockNodes;
+  if (blocks == 0)
+    Log::warning("Lazy tree budget is less than one block, subtrees will not be cached.");
+  mPool.resize(blocks * blockNodes);
+  mNextBlock.resize(blocks);
+  for (auto i = 0uz; i < blocks; i++)
+    mNextBlock[i] = i + 1 < blocks ? static_cast<uint32_t>(i + 1) : none;
+  mFreeBlock = blocks > 0 ? 0 : none;
+  mFreeBlocks = blocks;
+  mSlots.resize(blocks);
+  mFreeSlots.resize(blocks);
+  for (auto i = 0uz; i < blocks; i++)
+    mFreeSlots[i] = static_cast<uint32_t>(blocks - 1 - i);
+  mTable.assign(std::bit_ceil(std::max(blocks * 2, 1uz)), none);
+}
+
+uint32_t LazyTree::get(int64_t x, int64_t y, int64_t z) {
+  if (y < 0 || y >= static_cast<int64_t>(mHeight))
+    return 0;
+  // Arithmetic shifts round towards negative infinity.
+  auto const shift = static_cast<int64_t>(mSubtreeLevels);
+  auto const key = Key{x >> shift, y >> shift, z >> shift};
+  auto const root = mRejected == key ? none : subtree(key);
+  if (root == none) {
+    mStats.bypasses++;
+    // Same as `Tree::generateNode()`.
+    auto const height = WorldGen::getHeight(static_cast<double>(x), static_cast<double>(z)) + 64;
+    return y < height ? 1 : 0;
+  }
+  auto const mask = static_cast<int64_t>(mSubtreeSize - 1);
+  auto const lx = static_cast<size_t>(x & mask), ly = static_cast<size_t>(y & mask), lz = static_cast<size_t>(z & mask);
+  auto ind = static_cast<size_t>(root);
+  for (auto half = mSubtreeSize / 2; !mPool[ind].leaf; half /= 2) {
+    assert(mPool[ind].generated && half > 0);
+    ind = mPool[ind].data;
+    if (lx & half)
+      ind += 1;
+    if (ly & half)
+      ind += 2;
+    if (lz & half)
+      ind += 4;
+  }
+  return mPool[ind].data;
+}
+
+size_t LazyTree::find(Key const& key) const {
+  auto const mask = mTable.size() - 1;
+  auto i = KeyHash()(key) & mask;
+  while (mTable[i] != none && mSlots[mTable[i]].key != key)
+    i = (i + 1) & mask;
+  return i;
+}
+
+void LazyTree::unlink(uint32_t slot) {
+  auto& s = mSlots[slot];
+  (s.prev != none ? mSlots[s.prev].next : mHead) = s.next;
+  (s.next != none ? mSlots[s.next].prev : mTail) = s.prev;
+  s.prev = s.next = none;
+}
+
+void LazyTree::pushFront(uint32_t slot) {
+  auto& s = mSlots[slot];
+  s.prev = none;
+  s.next = mHead;
+  (mHead != none ? mSlots[mHead].prev : mTail) = slot;
+  mHead = slot;
+}
+
+void LazyTree::evict() {
+  auto const slot = mTail;
+  assert(slot != none);
+  auto& s = mSlots[slot];
+  unlink(slot);
+
+  // Backward-shift deletion keeps probe sequences unbroken.
+  auto const mask = mTable.size() - 1;
+  auto i = find(s.key);
+  assert(mTable[i] == slot);
+  for (auto j = (i + 1) & mask; mTable[j] != none; j = (j + 1) & mask) {
+    auto const home = KeyHash()(mSlots[mTable[j]].key) & mask;
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      mTable[i] = mTable[j];
+      i = j;
+    }
+  }
+  mTable[i] = none;
+
+  // Return the chain of blocks to the free list.
+  auto last = s.firstBlock;
+  auto count = 1uz;
+  for (; mNextBlock[last] != none; last = mNextBlock[last])
+    count++;
+  mNextBlock[last] = mFreeBlock;
+  mFreeBlock = s.firstBlock;
+  mFreeBlocks += count;
+
+  mResidentSubtrees--;
+  mResidentNodes -= s.nodes;
+  s = Slot();
+  mFreeSlots.push_back(slot);
+  mStats.evictions++;
+}
+
+uint32_t LazyTree::subtree(Key const& key) {
+  if (auto const i = find(key); mTable[i] != none) {
+    auto const slot = mTable[i];
+    mStats.hits++;
+    unlink(slot);
+    pushFront(slot);
+    return mSlots[slot].root;
+  }
+
+  if (mNextBlock.empty())
+    return none;
+
+  // Generate (deterministically) from `WorldGen`.
+  auto const size = static_cast<int64_t>(mSubtreeSize);
+  auto tree = Tree(mSubtreeSize, mHeight, key.x * size, key.y * size, key.z * size);
+  tree.generate(false);
+  auto const& nodes = tree.nodes();
+  auto const blocks = (rootOffset + nodes.size() + blockNodes - 1) / blockNodes;
+  if (blocks > mNextBlock.size()) {
+    // Remembered, as collision queries are coherent.
+    mRejected = key;
+    if (mStats.bypasses == 0) {
+      std::stringstream ss;
+      ss << "Lazy tree subtree of " << nodes.size() << " nodes exceeds the budget, querying it uncached.";
+      Log::warning(ss.str());
+    }
+    return none;
+  }
+  mStats.misses++;
+
+  // Evict cold subtrees until the new one fits.
+  while (mFreeBlocks < blocks)
+    evict();
+  mScratch.clear();
+  for (auto i = 0uz; i < blocks; i++) {
+    mScratch.push_back(mFreeBlock);
+    mFreeBlock = mNextBlock[mFreeBlock];
+  }
+  mNextBlock[mScratch.back()] = none;
+  mFreeBlocks -= blocks;
+
+  // Copy, relocating child pointers into the pool.
+  auto const poolIndex = [this](size_t ind) {
+    auto const offset = rootOffset + ind;
+    return static_cast<uint32_t>(mScratch[offset / blockNodes] * blockNodes + offset % blockNodes);
+  };
+  for (auto i = 0uz; i < nodes.size(); i++) {
+    auto node = nodes[i];
+    if (node.generated && !node.leaf)
+      node.data = poolIndex(node.data);
+    mPool[poolIndex(i)] = node;
+  }
+
+  auto const slot = mFreeSlots.back();
+  mFreeSlots.pop_back();
+  mSlots[slot] = Slot{.key = key, .root = poolIndex(0), .firstBlock = mScratch.front(), .nodes = nodes.size()};
+  mTable[find(key)] = slot;
+  pushFront(slot);
+  mResidentSubtrees++;
+  mResidentNodes += nodes.size();
+  return mSlots[slot].root;
+}
+
+void LazyTree::logStats() const {
+  auto const total = mStats.hits + mStats.misses;
+  std::stringstream ss;
+  ss << "Lazy tree: " << mStats.hits << " hits, " << mStats.misses << " misses";
+  if (total > 0)
+    ss << " (" << mStats.hits * 100 / total << "% hit rate)";
+  ss << ", " << mStats.evictions << " evictions, " << mStats.bypasses << " uncached queries, ";
+  ss << mResidentSubtrees << " subtrees (" << mResidentNodes << "/" << mPool.size() << " nodes) resident.";
+  Log::info(ss.str());
+}
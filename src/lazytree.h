@@ -0,0 +1,96 @@
+#ifndef LAZYTREE_H_
+#define LAZYTREE_H_
+
+#include <concepts>
+#include <cstdint>
+#include <vector>
+#include "tree.h"
+
+// A lazily generated octree on the CPU, for queries (collision etc.) on worlds too large to generate upfront.
+// The world is split into cubic subtrees of `2^subtreeLevels` blocks, generated from `WorldGen` on first access.
+// Resident subtrees live in a pool of `maxNodes` nodes allocated upfront, in fixed-size blocks; cold subtrees are
+// evicted in LRU order until a new one fits, and regenerated deterministically when touched again. Subtrees larger
+// than the whole pool are never cached: their blocks are computed directly. Not thread-safe.
+class LazyTree {
+public:
+  struct Stats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t bypasses = 0; // Queries in subtrees too large for the pool.
+  };
+
+  LazyTree(size_t subtreeLevels, size_t height, size_t maxNodes);
+
+  // Returns leaf data of the block at the given position (0 = air). Blocks outside `[0, height)` are air.
+  uint32_t get(int64_t x, int64_t y, int64_t z);
+
+  Stats const& stats() const { return mStats; }
+  void resetStats() { mStats = Stats(); }
+  size_t residentSubtrees() const { return mResidentSubtrees; }
+  size_t residentNodes() const { return mResidentNodes; }
+  void logStats() const;
+
+private:
+  // Nodes per pool block (a multiple of 8, so that sibling groups can be kept within a block).
+  static constexpr size_t blockNodes = 256;
+  static constexpr uint32_t none = UINT32_MAX;
+
+  struct Key {
+    int64_t x, y, z;
+    bool operator==(Key const&) const = default;
+  };
+
+  struct KeyHash {
+    size_t operator()(Key const& k) const {
+      auto res = static_cast<uint64_t>(k.x) * 0x9E3779B97F4A7C15ull;
+      res ^= static_cast<uint64_t>(k.y) * 0xC2B2AE3D27D4EB4Full + (res << 6) + (res >> 2);
+      res ^= static_cast<uint64_t>(k.z) * 0x165667B19E3779F9ull + (res << 6) + (res >> 2);
+      return static_cast<size_t>(res);
+    }
+  };
+
+  // A resident subtree. Its blocks are chained through `mNextBlock`.
+  struct Slot {
+    Key key;
+    uint32_t root = none; // Pool index of the root node.
+    uint32_t firstBlock = none;
+    size_t nodes = 0;
+    uint32_t prev = none, next = none; // LRU list.
+  };
+
+  size_t mSubtreeLevels, mSubtreeSize, mHeight;
+  Stats mStats;
+
+  // Node pool. Child pointers of resident subtrees are pool indices.
+  std::vector<Tree::Node> mPool;
+  std::vector<uint32_t> mNextBlock; // Next block of the same subtree, or of the free list.
+  uint32_t mFreeBlock = none;
+  size_t mFreeBlocks = 0;
+
+  // At most one subtree per block. Most recently used at `mHead`.
+  std::vector<Slot> mSlots;
+  std::vector<uint32_t> mFreeSlots;
+  uint32_t mHead = none, mTail = none;
+  size_t mResidentSubtrees = 0, mResidentNodes = 0;
+
+  // Open addressing from keys to slots (linear probing, at most half full).
+  std::vector<uint32_t> mTable;
+
+  // Blocks of the subtree being copied in (reused).
+  std::vector<uint32_t> mScratch;
+  // Last subtree found too large for the pool.
+  Key mRejected = {INT64_MIN, INT64_MIN, INT64_MIN};
+
+  // Returns the pool index of the root of the subtree, or `none` if it can never fit.
+  uint32_t subtree(Key const& key);
+  size_t find(Key const& key) const;
+  void unlink(uint32_t slot);
+  void pushFront(uint32_t slot);
+  void evict();
+};
+
+static_assert(std::move_constructible<LazyTree>);
+static_assert(std::assignable_from<LazyTree&, LazyTree&&>);
+
+#endif // LAZYTREE_H_
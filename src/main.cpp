@@ -1,20 +1,43 @@
+#include <algorithm>
 #include <array>
+#include <bit>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <type_traits>
+#include <utility>
+#include <vector>
 #include "bitmap.h"
 #include "camera.h"
+#include "chunkgrid.h"
+#include "concurrenttree.h"
 #include "config.h"
+#include "framecapture.h"
+#include "lazytree.h"
+#include "profiler.h"
+#include "programcache.h"
 #include "shaderstorage.h"
+#include "resolutioncontroller.h"
 #include "texture.h"
+#include "timerquery.h"
 #include "tree.h"
+#include "treestatistics.h"
+#include "uniformbuffer.h"
 #include "updatescheduler.h"
 #include "vertexarray.h"
 #include "window.h"
 
 struct MainOutputData {
   uint32_t count;
+  uint32_t freeGroups;
+  uint32_t pregenNodes;
+  uint32_t converged;
 };
 
 struct HitTestOutputData {
@@ -22,26 +45,126 @@ struct HitTestOutputData {
   bool onGround;
 };
 
+// Header of `WavefrontData` in `main.csh`, followed by three queues of `PathState` (48 bytes each in std430).
+struct WavefrontHeader {
+  std::array<uint32_t, 4> queueCount;
+  std::array<uint32_t, 4> dispatchArgs;
+};
+
+// `StatisticsData` in `main.csh` (`Debug.Statistics` only).
+constexpr auto statisticsBins = 12uz; // Must match `STATISTICS_BINS` in `main.csh`.
+struct StatisticsData {
+  uint32_t rays;
+  uint32_t iterationsLow;
+  uint32_t iterationsHigh;
+  uint32_t maxIterations;
+  uint32_t stackOverflows;
+  uint32_t iterationLimits;
+  uint32_t lockWaits;
+  uint32_t allocatedNodes;
+  uint32_t allocationFailures;
+  std::array<uint32_t, statisticsBins> histogram;
+};
+
+// `FrameParams` block in `main.csh` (std140, row-major matrices; booleans are 4 bytes).
+struct FrameParams {
+  std::array<float, 16> projectionInverse;
+  std::array<float, 16> modelViewInverse;
+  std::array<float, 3> cameraPosition;
+  float cameraFov;
+  float randomSeed;
+  uint32_t frameWidth;
+  uint32_t frameHeight;
+  uint32_t frameIndex;
+  uint32_t maxNodes;
+  float lodQuality;
+  uint32_t boundsSize;
+  uint32_t dynamicMode;
+  uint32_t infiniteMode;
+  uint32_t pathTracing;
+  uint32_t profilerOn;
+  uint32_t reprojectAvailable;
+  uint32_t depthOutput;
+  std::array<uint32_t, 3> padding; // std140 block size, rounded up to 16 bytes.
+};
+
 static_assert(std::is_standard_layout_v<MainOutputData> && std::is_trivially_copyable_v<MainOutputData>);
+static_assert(std::is_standard_layout_v<FrameParams> && std::is_trivially_copyable_v<FrameParams>);
+static_assert(offsetof(FrameParams, cameraFov) == 140 && offsetof(FrameParams, lodQuality) == 164);
+static_assert(offsetof(FrameParams, depthOutput) == 192 && sizeof(FrameParams) == 208);
+static_assert(std::is_standard_layout_v<WavefrontHeader> && std::is_trivially_copyable_v<WavefrontHeader>);
 static_assert(std::is_standard_layout_v<HitTestOutputData> && std::is_trivially_copyable_v<HitTestOutputData>);
-
-constexpr auto beamLevels = 1uz;
-constexpr auto beamSizes = std::array<size_t, beamLevels>{4uz};
+static_assert(std::is_standard_layout_v<StatisticsData> && std::is_trivially_copyable_v<StatisticsData>);
 
 constexpr auto frameTextureIndex = 0, noiseTextureIndex = 1, maxTextureIndex = 2, minTextureIndex = 3;
+constexpr auto historyTextureIndex = 4, resolvedTextureIndex = 5;
 constexpr auto frameImageIndex = 0;
-constexpr auto beamImageIndices = std::array<GLint, beamLevels>{1};
+constexpr auto beamImageBase = 1; // Beam level `i` uses image unit `beamImageBase + i`.
 constexpr auto treeBufferIndex = 0, mainOutputBufferIndex = 1, hitTestOutputBufferIndex = 2;
-
-auto initTreeBuffer(bool dynamicMode, size_t maxNodes, size_t worldSize, size_t maxHeight) -> ShaderStorage {
+constexpr auto stampBufferIndex = 3, freeListBufferIndex = 4, tileOrderBufferIndex = 5, boundsBufferIndex = 6;
+constexpr auto maxBoundsLevels = 32uz; // Must match `MAX_BOUNDS_LEVELS` in `main.csh`.
+constexpr auto pruneWorkgroups = 1024uz;
+constexpr auto wavefrontBufferIndex = 7, depthBufferIndex = 8, reprojectBufferIndex = 9, statisticsBufferIndex = 10;
+constexpr auto groupInfoBufferIndex = 13; // 11 and 12 are used by `TreeStats`.
+constexpr auto frameParamsBlockIndex = 0;
+constexpr auto wavefrontPathSize = 48uz;
+constexpr auto maxTracedRays = 2uz; // Injected as `MAX_TRACED_RAYS`; also the number of wavefront bounces.
+constexpr auto workgroupCandidates = std::array<std::array<size_t, 2>, 10>{{
+  {8, 8},
+  {16, 4},
+  {4, 16},
+  {32, 2},
+  {2, 32},
+  {64, 1},
+  {16, 8},
+  {8, 16},
+  {32, 4},
+  {16, 16},
+}};
+constexpr auto workgroupAutotuneViews = 8uz; // Yaw steps of a full turn, alternating between two pitches.
+constexpr auto upsampleScale = 2uz;
+constexpr auto upsampleJitters = std::array<std::array<GLuint, 2>, upsampleScale * upsampleScale>{{
+  {0, 0},
+  {1, 1},
+  {1, 0},
+  {0, 1},
+}};
+
+// Stages and queues of wavefront path tracing (see `WAVEFRONT_*` and `QUEUE_*` in `main.csh`).
+enum class WavefrontStage : GLuint { off, raygen, extend, shade, shadow, dispatch, accumulate };
+enum class WavefrontQueue : GLuint { paths, hits, shadows, none };
+
+auto initTreeBuffer(
+  bool dynamicMode,
+  size_t maxNodes,
+  size_t worldSize,
+  size_t maxHeight,
+  std::string const& storageFile,
+  bool childMasks
+) -> ShaderStorage {
   if (dynamicMode) {
     auto initialHeader = static_cast<uint32_t>(1);
     auto res = ShaderStorage(sizeof(initialHeader) + sizeof(uint32_t) * maxNodes);
     res.upload(0, sizeof(initialHeader), &initialHeader);
     return res;
   } else {
-    auto tree = Tree(worldSize, maxHeight);
+    auto tree = Tree(worldSize, maxHeight, storageFile);
     tree.generate();
+    if (childMasks) {
+      // Same header as the standard format (node count), followed by the descriptors.
+      auto const words = tree.exportChildMasks();
+      if (!tree.checkChildMasks(words))
+        Log::warning("Child-mask tree may render incorrectly.");
+      auto const header = static_cast<uint32_t>(words.size());
+      auto res = ShaderStorage(sizeof(header) + words.size() * sizeof(uint32_t));
+      res.upload(0, sizeof(header), &header);
+      res.upload(sizeof(header), words.size() * sizeof(uint32_t), words.data());
+      Log::info(
+        "Child-mask tree: " + std::to_string(res.size()) + " bytes (standard format: " +
+        std::to_string(tree.uploadSize()) + " bytes)."
+      );
+      return res;
+    }
     auto res = ShaderStorage(tree.uploadSize());
     tree.upload(res);
     return res;
@@ -142,6 +265,104 @@ void updateCameraInterval(
   velocity += camera.transformedVelocity(acc, Vec3i(0, 1, 0));
 }
 
+// Clips `velocity` so that the camera bounding box does not move into solid blocks, one axis at a time.
+template <typename F>
+void collideCamera(F const& solid, Camera const& camera, Vec3f& velocity, bool& onGround) {
+  auto boxMin = camera.position - Vec3f(0.3f, 1.5f, 0.3f);
+  auto boxMax = camera.position + Vec3f(0.3f, 0.2f, 0.3f);
+  auto const eps = 1e-3f;
+  auto const first = [](float lo) { return static_cast<int64_t>(std::floor(lo)); };
+  auto const last = [](float hi) { return static_cast<int64_t>(std::ceil(hi)) - 1; };
+  onGround = false;
+  for (auto axis: {&Vec3f::y, &Vec3f::x, &Vec3f::z}) {
+    auto& v = velocity.*axis;
+    if (v == 0.0f)
+      continue;
+    // Sweep through block layers perpendicular to the axis, stopping at the first one with solid blocks.
+    auto const positive = v > 0.0f;
+    auto const face = positive ? boxMax.*axis : boxMin.*axis;
+    auto const begin = positive ? last(face) + 1 : first(face) - 1;
+    auto const end = positive ? last(face + v) : first(face + v);
+    for (auto c = begin; positive ? c <= end : c >= end; c += positive ? 1 : -1) {
+      auto lo = boxMin, hi = boxMax;
+      lo.*axis = static_cast<float>(c);
+      hi.*axis = static_cast<float>(c + 1);
+      auto hit = false;
+      for (auto x = first(lo.x); x <= last(hi.x) && !hit; x++)
+        for (auto y = first(lo.y); y <= last(hi.y) && !hit; y++)
+          for (auto z = first(lo.z); z <= last(hi.z) && !hit; z++)
+            hit = solid(x, y, z);
+      if (hit) {
+        v = positive ? std::max(static_cast<float>(c) - face - eps, 0.0f)
+                     : std::min(static_cast<float>(c + 1) - face + eps, 0.0f);
+        if (axis == &Vec3f::y && !positive)
+          onGround = true;
+        break;
+      }
+    }
+    boxMin.*axis += v;
+    boxMax.*axis += v;
+  }
+}
+
+// Parses comma-separated beam sizes (coarse to fine). Each must be a power of two dividing the previous one.
+auto parseBeamSizes(std::string const& str) -> std::optional<std::vector<size_t>> {
+  auto res = std::vector<size_t>();
+  auto ss = std::stringstream(str);
+  for (auto item = std::string(); std::getline(ss, item, ',');) {
+    auto size = 0uz;
+    if (!(std::stringstream(item) >> size) || size < 2 || (size & (size - 1)) != 0)
+      return std::nullopt;
+    if (!res.empty() && (size >= res.back() || res.back() % size != 0))
+      return std::nullopt;
+    res.push_back(size);
+  }
+  return res;
+}
+
+auto formatBeamSizes(std::vector<size_t> const& sizes) -> std::string {
+  if (sizes.empty())
+    return "none";
+  auto ss = std::stringstream();
+  for (auto i = 0uz; i < sizes.size(); i++)
+    ss << (i > 0 ? "," : "") << sizes[i];
+  return ss.str();
+}
+
+// Beam hierarchies tried by autotuning: all subsets of sizes 32, 16, 8, 4, 2 with at most `maxLevels` elements.
+auto beamCandidates(size_t maxLevels) -> std::vector<std::vector<size_t>> {
+  auto res = std::vector<std::vector<size_t>>();
+  for (auto mask = 0u; mask < 32u; mask++) {
+    if (static_cast<size_t>(std::popcount(mask)) > maxLevels)
+      continue;
+    auto sizes = std::vector<size_t>();
+    for (auto bit = 5uz; bit-- > 0;)
+      if (mask & (1u << bit))
+        sizes.push_back(2uz << bit);
+    res.push_back(std::move(sizes));
+  }
+  return res;
+}
+
+// Logs the counters of `frames` frames.
+void logStatistics(StatisticsData const& stats, size_t frames) {
+  auto const perFrame = [&](double value) { return value / static_cast<double>(std::max(frames, 1uz)); };
+  auto const iterations = static_cast<double>(uint64_t(stats.iterationsHigh) << 32 | stats.iterationsLow);
+  auto ss = std::stringstream();
+  ss << "Statistics (" << frames << " frames):";
+  ss << "\n  Rays/frame: " << perFrame(stats.rays);
+  ss << ", iterations/ray: " << iterations / std::max(static_cast<double>(stats.rays), 1.0);
+  ss << " (max " << stats.maxIterations << ")";
+  ss << "\n  Exits: " << stats.stackOverflows << " stack overflows, " << stats.iterationLimits << " iteration limits";
+  ss << "\n  Nodes/frame: " << perFrame(stats.allocatedNodes) << " allocated, ";
+  ss << perFrame(stats.allocationFailures) << " allocation failures, " << perFrame(stats.lockWaits) << " lock waits";
+  ss << "\n  Iterations histogram:";
+  for (auto i = 0uz; i < statisticsBins; i++)
+    ss << " [" << (1uz << i) - 1 << ", " << (i + 1 < statisticsBins ? std::to_string((2uz << i) - 1) : "") << "): "
+       << stats.histogram[i];
+  Log::info(ss.str());
+}
+
 auto fullscreenQuad(float width, float height, float size) -> VertexArray {
   auto wfrac = width / size, hfrac = height / size;
   return VertexArray(VertexLayout(OpenGL::triangleStrip, 2, 2))
@@ -274,18 +495,81 @@ auto main() -> int {
   auto const debugContext = config.getOr("GL.Debugging", 0) != 0;
 
   auto const fov = config.getOr("Render.FieldOfView", 70.0f);
-  auto const workgroupWidth = config.getOr("Render.WorkgroupWidth", 8uz);
-  auto const workgroupHeight = config.getOr("Render.WorkgroupHeight", 8uz);
+  auto workgroupWidth = config.getOr("Render.WorkgroupWidth", 8uz);
+  auto workgroupHeight = config.getOr("Render.WorkgroupHeight", 8uz);
+  auto const workgroupAutotune = config.getOr("Render.WorkgroupAutotune", 0) != 0;
+  auto const workgroupAutotuneFrames = config.getOr("Render.WorkgroupAutotune.Frames", 4uz);
   auto const renderWidth = config.getOr("Render.RenderWidth", 0uz);
   auto const renderHeight = config.getOr("Render.RenderHeight", 0uz);
-
-  auto const dynamicMode = config.getOr("World.Dynamic", 0) != 0;
-  auto const maxNodes = config.getOr("World.Dynamic.MaxNodes", 268435454uz);
+  auto const wavefront = config.getOr("Render.Wavefront", 0) != 0;
+  auto const reprojection = config.getOr("Render.Reprojection", 1) != 0;
+  auto const upsampling = config.getOr("Render.TemporalUpsampling", 0) != 0;
+  auto const traversalStack = config.getOr("Render.TraversalStack", std::string("full"));
+  auto const shaderCache = config.getOr("Render.ShaderCache", 1) != 0;
+  auto const antiAliasing = config.getOr("Render.AntiAliasing", 1) != 0;
+  auto const depthOfField = config.getOr("Render.DepthOfField", 0) != 0;
+  auto const haltonSequence = config.getOr("Render.HaltonSequence", 1) != 0;
+  auto const gradientNormals = config.getOr("Render.GradientNormals", 1) != 0;
+  auto const sunLight = config.getOr("Render.SunLight", 1) != 0;
+  auto const skyLight = config.getOr("Render.SkyLight", 1) != 0;
+  auto const dynamicResolution = config.getOr("Render.DynamicResolution", 0) != 0;
+  auto const targetFrameTime = config.getOr("Render.DynamicResolution.TargetMs", 16.0);
+  auto const maxScale = std::clamp(config.getOr("Render.DynamicResolution.MaxScale", 1.0), 0.1, 1.0);
+  auto const minScale = std::clamp(config.getOr("Render.DynamicResolution.MinScale", 0.5), 0.1, maxScale);
+  auto const adaptiveThreshold = config.getOr("Render.Adaptive.Threshold", 0.02f);
+  auto const adaptiveMinSamples = config.getOr("Render.Adaptive.MinSamples", 16uz);
+  auto const beamSizesString = config.getOr("Render.BeamSizes", std::string("4"));
+  auto const beamAutotune = config.getOr("Render.BeamAutotune", 0) != 0;
+  auto const beamAutotuneLevels = config.getOr("Render.BeamAutotune.MaxLevels", 3uz);
+  auto const beamAutotuneFrames = config.getOr("Render.BeamAutotune.Frames", 4uz);
+
+  auto const infiniteMode = config.getOr("World.Infinite", 0) != 0;
+  auto const chunkLevels = config.getOr("World.Infinite.ChunkLevels", 8uz);
+  auto const gridSize = config.getOr("World.Infinite.GridSize", 8uz);
+  auto const slotNodes = config.getOr("World.Infinite.SlotNodes", 524288uz);
+  auto const chunkWorkers = config.getOr("World.Infinite.Workers", 2uz);
+  auto const chunkUploads = config.getOr("World.Infinite.UploadsPerFrame", 2uz);
+
+  auto const dynamicMode = config.getOr("World.Dynamic", 0) != 0 && !infiniteMode;
+  auto const maxNodesSetting = config.getOr("World.Dynamic.MaxNodes", 268435454uz);
+  auto const maxNodes = std::min(maxNodesSetting, Tree::maxNodes);
+  if (dynamicMode && maxNodes < maxNodesSetting)
+    Log::warning("Node budget exceeds the child pointer range, using " + std::to_string(maxNodes) + " nodes.");
   auto const maxHeight = config.getOr("World.Static.MaxHeight", 256uz);
+  auto const storageFile = config.getOr("World.Static.StorageFile", std::string());
+  auto const childMasks = config.getOr("World.Static.ChildMasks", 0) != 0 && !dynamicMode && !infiniteMode;
   auto const worldLevels = config.getOr("World.MaxLevels", 8uz);
   auto const noiseLevels = config.getOr("World.Dynamic.NoiseLevels", 8uz);
   auto const partialLevels = config.getOr("World.Dynamic.PartialLevels", 4uz);
   auto const lodQuality = config.getOr("World.Dynamic.LodQuality", 0.5f);
+  auto const pruneInterval = config.getOr("World.Dynamic.PruneInterval", 30uz);
+  auto const pruneAge = config.getOr("World.Dynamic.PruneAge", 120uz);
+  auto const pruneLodFactor = config.getOr("World.Dynamic.PruneLodFactor", 4.0f);
+  auto const pregenBudget = config.getOr("World.Dynamic.PregenBudget", 65536uz);
+  auto const pregenTileSize = config.getOr("World.Dynamic.PregenTileSize", 8uz);
+  auto const boundsSize = config.getOr("World.Dynamic.BoundsWindow", 256uz);
+  auto const profiling = config.getOr("Debug.Profiler", 0) != 0;
+  auto const profilerWindow = config.getOr("Debug.Profiler.Window", 240uz);
+  auto const profilerTrace = config.getOr("Debug.Profiler.Trace", std::string());
+  auto const statistics = config.getOr("Debug.Statistics", 0) != 0;
+  auto const treeStatsInterval = config.getOr("Debug.TreeStats.Interval", 0.0);
+  auto const treeStatsMaxNodes = config.getOr("Debug.TreeStats.MaxNodes", 16777216uz);
+  auto const captureSlots = config.getOr("Debug.Capture.Slots", 4uz);
+  auto const captureWorkers = config.getOr("Debug.Capture.Workers", 2uz);
+  auto const collisionLevels = config.getOr("World.Collision.SubtreeLevels", 5uz);
+  auto const collisionNodes = config.getOr("World.Collision.MaxNodes", 1048576uz);
+
+  // Concurrent tree self-test and scaling benchmark (runs instead of the renderer).
+  if (config.getOr("Debug.ConcurrentTree", 0) != 0) {
+    auto const levels = config.getOr("Debug.ConcurrentTree.Levels", 9uz);
+    auto const threads = config.getOr("Debug.ConcurrentTree.Threads", 0uz);
+    auto const queries = config.getOr("Debug.ConcurrentTree.Queries", 4194304uz);
+    auto const maxThreads = threads > 0 ? threads : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    auto const ok = ConcurrentTree::stressTest(levels, maxThreads, queries / 16);
+    ConcurrentTree::benchmark(levels, maxThreads, queries);
+    config.save(configPath() + configFilename());
+    return ok ? 0 : 1;
+  }
 
   auto& window = Window::singleton("", 852, 480, multisample, forceMinimumVersion, debugContext);
   auto& gl = window.gl();
@@ -293,26 +577,184 @@ auto main() -> int {
   Log::info("Renderer: " + gl.getString(GL_RENDERER) + " [" + gl.getString(GL_VENDOR) + "]");
   Log::info("OpenGL version: " + gl.getString(GL_VERSION));
 
-  // Load shaders.
-  auto const basicShader = ShaderProgram({
-    ShaderStage(OpenGL::vertexShader, shaderPath() + "basic.vsh"),
-    ShaderStage(OpenGL::fragmentShader, shaderPath() + "basic.fsh"),
+  // Tree diff/patch and span upload self-check (runs instead of the renderer).
+  if (config.getOr("Debug.TreePatch", 0) != 0) {
+    auto const levels = config.getOr("Debug.TreePatch.Levels", 8uz);
+    auto const edits = config.getOr("Debug.TreePatch.Edits", 4096uz);
+    auto const ok = Tree::patchSelfTest(levels, edits);
+    config.save(configPath() + configFilename());
+    return ok ? 0 : 1;
+  }
+
+  // Beam hierarchy (coarse to fine), with enough image slots in the shader for it and for autotuning candidates.
+  auto const parsedBeamSizes = parseBeamSizes(beamSizesString);
+  if (!parsedBeamSizes)
+    Log::warning("Invalid beam sizes `" + beamSizesString + "`, using `4`.");
+  auto beamSizes = parsedBeamSizes.value_or(std::vector<size_t>{4});
+  auto maxImageUniforms = GLint(0);
+  glGetIntegerv(GL_MAX_COMPUTE_IMAGE_UNIFORMS, &maxImageUniforms);
+  auto const beamCapacity = std::clamp(
+    std::max(beamSizes.size(), beamAutotune ? beamAutotuneLevels : 0uz),
+    1uz,
+    static_cast<size_t>(std::max(maxImageUniforms - beamImageBase - 2, 1))
+  );
+  auto const resolveImageIndex = beamImageBase + static_cast<GLint>(beamCapacity);
+  auto const accumImageIndex = resolveImageIndex + 1;
+  if (beamSizes.size() > beamCapacity) {
+    Log::warning("Too many beam levels, keeping the first " + std::to_string(beamCapacity) + ".");
+    beamSizes.resize(beamCapacity);
+  }
+  auto beamAutotunePending = beamAutotune;
+
+  // Load shaders (linked binaries are cached across launches).
+  auto const programCache = ProgramCache(shaderCache ? shaderCachePath() : "");
+  auto const basicShader = programCache.load({
+    {OpenGL::vertexShader, shaderPath() + "basic.vsh"},
+    {OpenGL::fragmentShader, shaderPath() + "basic.fsh"},
   });
 
-  auto const mainShader = ShaderProgram({ShaderStage(OpenGL::computeShader, shaderPath() + "main.csh")});
-  auto const mainOutput = ShaderStorage(sizeof(MainOutputData));
+  // Specialise shaders for the configuration: sizes that never change at run time become constants.
+  // In infinite mode, the octree levels are those of a single chunk.
+  auto const treeLevels = infiniteMode ? chunkLevels : worldLevels;
+  auto mainDefines = ShaderDefines();
+  mainDefines.set("BEAM_LEVELS", beamCapacity);
+  mainDefines.set("MAX_LEVELS", treeLevels).set("NOISE_LEVELS", noiseLevels).set("PARTIAL_LEVELS", partialLevels);
+  // Traversal stack variant: `full` (box origin and data per level), `compact` (data only) or `short` (4 levels).
+  if (traversalStack == "short")
+    mainDefines.set("CAST_RAY_USE_SHORT_STACK");
+  else
+    mainDefines.set("STACK_SIZE", treeLevels + 1);
+  if (traversalStack == "compact")
+    mainDefines.set("CAST_RAY_USE_COMPACT_STACK");
+  else if (traversalStack != "full" && traversalStack != "short")
+    Log::warning("Unknown traversal stack `" + traversalStack + "`, using `full`.");
+  mainDefines.set("MAX_TRACED_RAYS", maxTracedRays);
+  if (childMasks)
+    mainDefines.set("TREE_CHILD_MASKS").set("CHILD_MASK_ROOT", Tree::childMaskRoot);
+  if (statistics)
+    mainDefines.set("STATISTICS");
+  mainDefines.set("HOST_FEATURES");
+  for (auto const& [name, enabled]: {
+         std::pair{"ANTI_ALIASING", antiAliasing},
+         std::pair{"DEPTH_OF_FIELD", depthOfField},
+         std::pair{"HALTON_SEQUENCE", haltonSequence},
+         std::pair{"TERRAIN_GRADIENT_NORMAL", gradientNormals},
+         std::pair{"LIGHTING_SUN", sunLight},
+         std::pair{"LIGHTING_SKY", skyLight},
+       })
+    if (enabled)
+      mainDefines.set(name);
+
+  // Compute shaders with a given workgroup shape.
+  auto const mainSources = [&](size_t width, size_t height) {
+    auto defines = mainDefines;
+    defines.set("WORKGROUP_WIDTH", width).set("WORKGROUP_HEIGHT", height);
+    return std::vector<ShaderSource>{{OpenGL::computeShader, shaderPath() + "main.csh", defines.str()}};
+  };
+  auto const resolveSources = [&](size_t width, size_t height) {
+    auto defines = ShaderDefines();
+    defines.set("WORKGROUP_WIDTH", width).set("WORKGROUP_HEIGHT", height);
+    return std::vector<ShaderSource>{{OpenGL::computeShader, shaderPath() + "resolve.csh", defines.str()}};
+  };
+
+  // The main shader is the slowest to build, so it is built in the background while the world is generated.
+  // Each configuration is a separate program, cached under its own key.
+  auto mainShaderLoader = programCache.loadAsync(window, mainSources(workgroupWidth, workgroupHeight));
+  auto frameParams = UniformBuffer(sizeof(FrameParams));
+  auto mainOutput = ShaderStorage(sizeof(MainOutputData));
   mainOutput.bindAt(mainOutputBufferIndex);
+  // Copied at the end of every frame and read a few frames later.
+  auto mainOutputReadback = ReadbackRing(sizeof(MainOutputData));
+  auto mainOutputData = MainOutputData();
+
+  auto resolveShader = programCache.load(resolveSources(workgroupWidth, workgroupHeight));
+  auto const pruneShader = programCache.load({{OpenGL::computeShader, shaderPath() + "prune.csh"}});
+
+  // Traversal and generation counters, read back and cleared once per second, and logged once the copy has
+  // completed (one second later).
+  auto statisticsBuffer = ShaderStorage();
+  auto statisticsReadback = ReadbackRing();
+  auto statisticsFrames = 0uz, statisticsPendingFrames = 0uz;
+  if (statistics) {
+    statisticsBuffer = ShaderStorage(sizeof(StatisticsData));
+    statisticsBuffer.fill(0);
+    statisticsBuffer.bindAt(statisticsBufferIndex);
+    statisticsReadback = ReadbackRing(sizeof(StatisticsData), 1);
+  }
+
+  // Tree statistics (C, or every `treeStatsInterval` seconds), computed on the GPU and logged once ready.
+  // Buffers are allocated on first use.
+  auto treeStats = std::optional<TreeStatistics>();
+  auto treeStatsRequested = false;
+  auto treeStatsTime = UpdateScheduler::timeFromEpoch();
+
+  // Screenshots and frame capture, read back and saved in the background (started on first use).
+  auto frameCapture = std::optional<FrameCapture>();
+  auto screenshotRequested = false, recording = false;
+  auto recordingPath = std::string();
+  auto recordingFrame = 0uz;
 
   // auto const hitTestShader = ShaderProgram({ShaderStage(OpenGL::computeShader, shaderPath() + "hit_test.csh")});
   // auto const hitTestOutput = ShaderStorage(sizeof(HitTestOutputData));
   // hitTestOutput.bindAt(hitTestOutputBufferIndex);
 
   // Initialise voxels.
-  auto const worldSize = 1uz << worldLevels;
+  auto const worldSize = 1uz << treeLevels;
   auto const noiseSize = 1uz << noiseLevels;
-  auto treeBuffer = initTreeBuffer(dynamicMode, maxNodes, worldSize, maxHeight);
+  auto chunkGrid = std::optional<ChunkGrid>();
+  auto treeBuffer = ShaderStorage();
+  if (infiniteMode) {
+    chunkGrid.emplace(chunkLevels, gridSize, slotNodes, chunkWorkers);
+    treeBuffer = ShaderStorage(chunkGrid->bufferSize());
+    chunkGrid->init(treeBuffer);
+  } else {
+    treeBuffer = initTreeBuffer(dynamicMode, maxNodes, worldSize, maxHeight, storageFile, childMasks);
+  }
   treeBuffer.bindAt(treeBufferIndex);
 
+  // Node recycling (dynamic mode): per-group stamps and parents are written on allocation, so only the free list
+  // needs setup.
+  auto stampBuffer = ShaderStorage(), groupInfoBuffer = ShaderStorage(), freeListBuffer = ShaderStorage();
+  if (dynamicMode) {
+    auto const groups = maxNodes / 8 + 1;
+    auto const initialFreeCount = static_cast<int32_t>(0);
+    stampBuffer = ShaderStorage(groups * sizeof(uint32_t));
+    groupInfoBuffer = ShaderStorage(groups * sizeof(uint32_t));
+    freeListBuffer = ShaderStorage(sizeof(initialFreeCount) + groups * sizeof(uint32_t));
+    freeListBuffer.upload(0, sizeof(initialFreeCount), &initialFreeCount);
+    stampBuffer.bindAt(stampBufferIndex);
+    groupInfoBuffer.bindAt(groupInfoBufferIndex);
+    freeListBuffer.bindAt(freeListBufferIndex);
+  }
+  auto frameIndex = 1uz;
+
+  // Height bounds (dynamic mode): a window of `boundsSize^2` cells per level, re-centred as the camera moves.
+  auto const boundsEnabled = dynamicMode && boundsSize > 0;
+  auto const boundsLevels = std::min(treeLevels + 1, maxBoundsLevels);
+  auto boundsBuffer = ShaderStorage();
+  auto boundsOrigin = std::vector<GLuint>(boundsLevels * 2), boundsPrevOrigin = boundsOrigin;
+  auto boundsPrevValid = false;
+  if (boundsEnabled) {
+    boundsBuffer = ShaderStorage(boundsLevels * boundsSize * boundsSize * 2 * sizeof(float));
+    boundsBuffer.bindAt(boundsBufferIndex);
+  }
+
+  // Pre-generation (dynamic mode): screen tiles sorted centre-out, rebuilt on resize.
+  auto const pregenEnabled = dynamicMode && pregenBudget > 0 && pregenTileSize > 0;
+  auto tileOrderBuffer = ShaderStorage();
+  auto pregenTiles = 0uz;
+
+  // Lazily generated CPU copy of the world for collision (dynamic mode generates terrain on the GPU only).
+  auto lazyTree = std::optional<LazyTree>();
+  if (!dynamicMode)
+    lazyTree.emplace(collisionLevels, infiniteMode ? worldSize : std::min(worldSize, maxHeight), collisionNodes);
+  auto const solid = [&](int64_t x, int64_t y, int64_t z) {
+    auto const size = static_cast<int64_t>(worldSize);
+    if (!infiniteMode && (x < 0 || x >= size || z < 0 || z >= size))
+      return false;
+    return lazyTree->get(x, y, z) != 0;
+  };
+
   // Initialise noise.
   auto noiseImage = Bitmap(noiseSize, noiseSize, 4);
   for (size_t x = 0; x < noiseSize; x++)
@@ -348,16 +790,71 @@ auto main() -> int {
   minTexture.bindAt(minTextureIndex);
 
   // Initialise (empty) frame textures.
+  // Textures are allocated for the output size; `frameWidth * frameHeight` is the part being rendered.
+  auto outputWidth = 0uz, outputHeight = 0uz;
   auto frameWidth = 0uz, frameHeight = 0uz, frameSize = 0uz;
   auto frame = Texture();
   frame.bindAt(frameTextureIndex);
   glBindImageTexture(frameImageIndex, frame.handle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
-  auto beams = std::array<Texture, beamLevels>();
-  for (auto i = 0uz; i < beamLevels; i++) {
+  auto accum = Texture(); // Path tracing: running mean and variance (see `AccumImage` in `main.csh`).
+  auto accumSamples = 0uz;
+  auto beams = std::vector<Texture>(beamCapacity);
+  auto beamImageIndices = std::vector<GLint>(beamCapacity);
+  for (auto i = 0uz; i < beamCapacity; i++) {
+    beamImageIndices[i] = beamImageBase + static_cast<GLint>(i);
     glBindImageTexture(beamImageIndices[i], beams[i].handle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
   }
+
+  // Texture and image units never change (but programs are rebuilt by workgroup autotuning).
+  auto const initMainShader = [&](ShaderProgram const& program) {
+    program.use();
+    program.uniformImage("FrameImage", frameImageIndex);
+    program.uniformImages("BeamImage", beamCapacity, beamImageIndices.data());
+    program.uniformImage("AccumImage", accumImageIndex);
+    program.uniformFloat("AdaptiveThreshold", adaptiveThreshold);
+    program.uniformUInt("AdaptiveMinSamples", static_cast<GLuint>(adaptiveMinSamples));
+    program.uniformSampler("NoiseTexture", noiseTextureIndex);
+    program.uniformSampler("MaxTexture", maxTextureIndex);
+    program.uniformSampler("MinTexture", minTextureIndex);
+  };
+  auto const initResolveShader = [&](ShaderProgram const& program) {
+    program.use();
+    program.uniformImage("SampleImage", frameImageIndex);
+    program.uniformImage("OutputImage", resolveImageIndex);
+    program.uniformSampler("HistoryTexture", historyTextureIndex);
+  };
+  auto mainShader = mainShaderLoader.get();
+  initMainShader(mainShader);
+  initResolveShader(resolveShader);
+  auto workgroupAutotunePending = workgroupAutotune;
+  auto const reallocateBeams = [&](std::vector<size_t> const& sizes) {
+    for (auto i = 0uz; i < sizes.size(); i++)
+      beams[i].reallocate(std::max(frameSize / sizes[i], 1uz), OpenGL::internalFormat4f);
+  };
   auto quad = VertexBuffer(fullscreenQuad(0.0f, 0.0f, 0.0f), true);
 
+  // Wavefront path tracing: ray queues sized for one path per pixel, reallocated on resize. Frames with more pixels
+  // than fit in a storage block are traced in bands of rows.
+  auto wavefrontBuffer = ShaderStorage();
+  auto wavefrontCapacity = 0uz; // Paths per queue.
+  auto maxStorageBlockSize = GLint64(0);
+  glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maxStorageBlockSize);
+
+  // Temporal upsampling: full-resolution outputs of the current and previous frames.
+  auto history = std::array<Texture, 2>();
+  auto historyIndex = 0uz;
+  auto historyValid = false;
+
+  // Dynamic resolution: scales the render size toward a target GPU time of the render passes.
+  auto resolution = std::optional<ResolutionController>();
+  if (dynamicResolution)
+    resolution.emplace(std::max(targetFrameTime, 1.0), minScale, maxScale);
+
+  // Temporal reprojection: primary hit distances of the previous frame and their reprojection into the current one.
+  auto depthBuffer = ShaderStorage(), reprojectBuffer = ShaderStorage();
+  auto reprojectValid = false;
+  auto prevCamera = Camera();
+
   // Camera parameters.
   auto camera = Camera();
   camera.fov = fov;
@@ -377,6 +874,22 @@ auto main() -> int {
 
   auto frameCounterScheduler = UpdateScheduler(1.0);
   auto frameCounter = 0uz;
+  auto sampleCounter = 0uz;
+  auto frameRays = 0uz; // Primary rays traced by the final pass of the last frame.
+  auto submitTime = 0.0; // CPU time spent issuing render commands since the last title update, in seconds.
+
+  // GPU time per pass (F3 logs a summary).
+  auto profiler = std::optional<Profiler>();
+  if (profiling)
+    profiler.emplace(profilerWindow, profilerTrace);
+  auto const profileBegin = [&](std::string const& pass) {
+    if (profiler)
+      profiler->begin(pass);
+  };
+  auto const profileEnd = [&]() {
+    if (profiler)
+      profiler->end();
+  };
 
   auto startTime = UpdateScheduler::timeFromEpoch();
   auto pathTracing = false;
@@ -405,6 +918,7 @@ auto main() -> int {
         pathTracing = !pathTracing;
         window.setMouseLocked(!pathTracing);
         frameCounter = 0;
+        accumSamples = 0;
       }
       ppressed = true;
     } else {
@@ -413,11 +927,10 @@ auto main() -> int {
 
     static bool cpressed = false;
     if (window.isKeyPressed(SDL_SCANCODE_C)) {
-      if (!cpressed) {
-        auto curr = Tree(1, 1);
-        curr.download(treeBuffer);
-        curr.check();
-      }
+      if (!cpressed && !infiniteMode && !childMasks)
+        treeStatsRequested = true;
+      if (!cpressed && lazyTree)
+        lazyTree->logStats();
       cpressed = true;
     } else {
       cpressed = false;
@@ -425,8 +938,8 @@ auto main() -> int {
 
     static bool gpressed = false;
     if (window.isKeyPressed(SDL_SCANCODE_G)) {
-      if (!gpressed) {
-        auto curr = Tree(1, 1), opt = Tree(1, 1);
+      if (!gpressed && !infiniteMode && !childMasks) {
+        auto curr = Tree(1, 1, storageFile), opt = Tree(1, 1, storageFile.empty() ? "" : storageFile + ".gc");
         curr.download(treeBuffer);
         curr.gc(opt);
         opt.upload(treeBuffer);
@@ -436,6 +949,15 @@ auto main() -> int {
       gpressed = false;
     }
 
+    static bool f3pressed = false;
+    if (window.isKeyPressed(SDL_SCANCODE_F3)) {
+      if (!f3pressed && profiler)
+        profiler->dump();
+      f3pressed = true;
+    } else {
+      f3pressed = false;
+    }
+
     static bool f1pressed = false;
     if (window.isKeyPressed(SDL_SCANCODE_F1)) {
       if (!f1pressed)
@@ -463,38 +985,37 @@ auto main() -> int {
       f4pressed = false;
     }
 
-    // Screenshot.
-    /*
+    // Screenshot (O), or capture every frame (F5).
     static bool opressed = false;
     if (window.isKeyPressed(SDL_SCANCODE_O)) {
-      if (!opressed) {
-        if (pathTracing) {
-          // Read pixel data.
-          auto bmp = Bitmap(frameWidth, frameHeight, 3);
-          Texture::select(frameTextureIndices.back());
-          glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, bmp.data());
-          // Gamma conversion.
-          auto const gamma = 2.2;
-          for (auto i = 0uz; i < bmp.height(); i++)
-            for (auto j = 0uz; j < bmp.width(); j++) {
-              for (auto k = 0uz; k < bmp.bytesPerPixel(); k++) {
-                auto col = bmp.at(j, i, k) / 255.0;
-                col = pow(col, 1.0 / gamma);
-                bmp.at(j, i, k) = static_cast<uint8_t>(col * 255.0);
-              }
-            }
-          // Save file.
+      if (!opressed)
+        screenshotRequested = true;
+      opressed = true;
+    } else {
+      opressed = false;
+    }
+
+    static bool f5pressed = false;
+    if (window.isKeyPressed(SDL_SCANCODE_F5)) {
+      if (!f5pressed) {
+        recording = !recording;
+        if (recording) {
+          std::stringstream ss;
+          ss << screenshotPath() << "capture-" << static_cast<uint64_t>(UpdateScheduler::timeFromEpoch()) << "/";
+          recordingPath = ss.str();
+          recordingFrame = 0;
+          Log::info("Capturing frames to `" + recordingPath + "`.");
+        } else {
           std::stringstream ss;
-          ss << screenshotPath() << frameWidth << "x" << frameHeight << "-" << frameCounter << "spp-"
-             << UpdateScheduler::timeFromEpoch() - startTime << "s.bmp";
-          bmp.swapChannels(0, 2);
-          bmp.save(ss.str());
-          Log::info("Saved screenshot `" + ss.str() + "`.");
+          ss << "Stopped capturing after " << recordingFrame << " frames (";
+          ss << (frameCapture ? frameCapture->dropped() : 0uz) << " dropped since start).";
+          Log::info(ss.str());
         }
       }
-      opressed = true;
-    } else opressed = false;
-    */
+      f5pressed = true;
+    } else {
+      f5pressed = false;
+    }
 
     // Update camera.
     if (!pathTracing) {
@@ -509,6 +1030,8 @@ auto main() -> int {
           cameraOnGround,
           cameraFlying || cameraCrossWall
         );
+        if (lazyTree && !cameraFlying && !cameraCrossWall)
+          collideCamera(solid, camera, cameraVelocity, cameraOnGround);
         /*
         if (!cameraCrossWall) {
           // Invoke the hit test program.
@@ -536,30 +1059,53 @@ auto main() -> int {
 
     // Update FPS.
     frameCounter++;
+    statisticsFrames++;
+    if (auto const latest = mainOutputReadback.latest<MainOutputData>())
+      mainOutputData = *latest;
     frameCounterScheduler.refresh();
     while (!frameCounterScheduler.inSync()) {
-      // Count nodes.
-      glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
-      auto data = MainOutputData();
-      mainOutput.download(0, sizeof(MainOutputData), &data);
+      auto const& data = mainOutputData;
       // Update window title.
       std::stringstream ss;
       ss << "Voxel Raycasting Test (";
-      if (dynamicMode) {
-        ss << data.count << " (" << static_cast<size_t>(data.count) * 100 / maxNodes << "%) nodes dynamic";
+      if (infiniteMode) {
+        ss << chunkGrid->loaded() << "/" << gridSize * gridSize << " chunks infinite";
+      } else if (dynamicMode) {
+        ss << data.count << " (" << static_cast<size_t>(data.count) * 100 / maxNodes << "%) nodes, ";
+        ss << data.freeGroups << " free groups dynamic";
       } else {
         ss << data.count << " nodes static";
       }
       if (pathTracing) {
-        ss << ", " << frameCounter << " samples per pixel";
+        auto const pixels = std::max(frameWidth * frameHeight, 1uz);
+        ss << ", " << accumSamples << " samples per pixel, ";
+        ss << static_cast<size_t>(data.converged) * 100 / pixels << "% converged, ";
+        ss << static_cast<double>(sampleCounter) / 1e6 << (wavefront ? " Msamples/s wavefront" : " Msamples/s");
       } else {
-        ss << ", FPS: " << frameCounter << ", X: " << camera.position.x << ", Y: " << camera.position.y
-           << ", Z: " << camera.position.z;
+        ss << ", FPS: " << frameCounter << ", " << static_cast<double>(frameRays) / 1e6 << " Mrays/frame";
+        if (resolution)
+          ss << ", " << frameWidth << "x" << frameHeight << " at " << resolution->frameTime() << " ms";
+        ss << ", CPU: " << submitTime * 1e3 / static_cast<double>(std::max(frameCounter, 1uz)) << " ms";
+        ss << ", X: " << camera.position.x << ", Y: " << camera.position.y << ", Z: " << camera.position.z;
         frameCounter = 0;
       }
       ss << ")";
+      sampleCounter = 0;
+      submitTime = 0.0;
       Window::singleton().setTitle(ss.str());
       frameCounterScheduler.increase();
+
+      // Log the statistics of the previous second, and start reading back the current ones.
+      if (statistics) {
+        if (auto const stats = statisticsReadback.poll<StatisticsData>())
+          logStatistics(*stats, statisticsPendingFrames);
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        if (statisticsReadback.copy(statisticsBuffer)) {
+          statisticsBuffer.fill(0);
+          statisticsPendingFrames = statisticsFrames;
+          statisticsFrames = 0;
+        }
+      }
     }
 
     // Exit program if ESC is pressed.
@@ -570,18 +1116,60 @@ auto main() -> int {
     // Render frame.
     // =============
 
-    // Check if frame textures should be resized.
+    // Check if frame textures should be resized (to the output size), then choose the render size within them.
     if (!pathTracing) {
       auto const width = renderWidth > 0 ? renderWidth : window.width();
       auto const height = renderHeight > 0 ? renderHeight : window.height();
-      if (frameWidth != width || frameHeight != height) {
-        frameWidth = width;
-        frameHeight = height;
+      if (outputWidth != width || outputHeight != height) {
+        outputWidth = width;
+        outputHeight = height;
         frameSize = 1uz << ceilLog2(std::max(width, height));
         frame.reallocate(frameSize, OpenGL::internalFormat4f);
-        for (auto i = 0uz; i < beamLevels; i++) {
-          beams[i].reallocate(frameSize / beamSizes[i], OpenGL::internalFormat4f);
+        accum.reallocate(frameSize, OpenGL::internalFormat4f);
+        glBindImageTexture(accumImageIndex, accum.handle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+        reallocateBeams(beamSizes);
+        beamAutotunePending = beamAutotune;
+        camera.aspect = static_cast<float>(outputWidth) / static_cast<float>(outputHeight);
+        if (upsampling) {
+          for (auto& texture: history)
+            texture.reallocate(frameSize, OpenGL::internalFormat4f);
+        }
+        if (reprojection || upsampling) {
+          depthBuffer = ShaderStorage(outputWidth * outputHeight * sizeof(float));
+          reprojectBuffer = ShaderStorage(outputWidth * outputHeight * sizeof(uint32_t));
+          depthBuffer.bindAt(depthBufferIndex);
+          reprojectBuffer.bindAt(reprojectBufferIndex);
+        }
+        if (wavefront) {
+          auto const maxCapacity = (static_cast<size_t>(maxStorageBlockSize) - sizeof(WavefrontHeader)) /
+                                   (3 * wavefrontPathSize);
+          wavefrontCapacity = std::min(outputWidth * outputHeight, maxCapacity);
+          if (wavefrontCapacity < outputWidth * outputHeight) {
+            std::stringstream ss;
+            ss << "Wavefront queues limited to " << wavefrontCapacity << " paths by the storage block size, ";
+            ss << "tracing in bands of rows.";
+            Log::warning(ss.str());
+          }
+          wavefrontBuffer = ShaderStorage(sizeof(WavefrontHeader) + 3 * wavefrontCapacity * wavefrontPathSize);
+          wavefrontBuffer.bindAt(wavefrontBufferIndex);
+          glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, wavefrontBuffer.handle());
         }
+        frameWidth = frameHeight = 0;
+      }
+
+      // Render size: the output size, or a multiple of 8 pixels below it with dynamic resolution.
+      if (resolution)
+        resolution->update();
+      auto const scaled = [&](size_t size) {
+        if (!resolution)
+          return size;
+        auto const res = static_cast<size_t>(std::lround(static_cast<double>(size) * resolution->scale() / 8.0)) * 8;
+        return std::clamp(res, std::min(size, 8uz), size);
+      };
+      if (frameWidth != scaled(outputWidth) || frameHeight != scaled(outputHeight)) {
+        frameWidth = scaled(outputWidth);
+        frameHeight = scaled(outputHeight);
+        // The present pass stretches the used part of `frame` over the window.
         quad = VertexBuffer(
           fullscreenQuad(
             static_cast<float>(frameWidth),
@@ -590,76 +1178,476 @@ auto main() -> int {
           ),
           true
         );
-        camera.aspect = static_cast<float>(frameWidth) / static_cast<float>(frameHeight);
+        reprojectValid = false;
+        historyValid = false;
+        if (pregenEnabled) {
+          auto const tilesX = (frameWidth - 1) / pregenTileSize + 1, tilesY = (frameHeight - 1) / pregenTileSize + 1;
+          auto order = std::vector<uint32_t>();
+          for (auto y = 0uz; y < tilesY; y++)
+            for (auto x = 0uz; x < tilesX; x++)
+              order.push_back(static_cast<uint32_t>(x | y << 16));
+          std::ranges::sort(order, {}, [tilesX, tilesY](uint32_t tile) {
+            auto const dx = 2.0 * static_cast<double>(tile & 0xFFFF) + 1.0 - static_cast<double>(tilesX);
+            auto const dy = 2.0 * static_cast<double>(tile >> 16) + 1.0 - static_cast<double>(tilesY);
+            return dx * dx + dy * dy;
+          });
+          pregenTiles = order.size();
+          tileOrderBuffer = ShaderStorage(order.size() * sizeof(uint32_t));
+          tileOrderBuffer.upload(0, order.size() * sizeof(uint32_t), order.data());
+          tileOrderBuffer.bindAt(tileOrderBufferIndex);
+        }
       }
     }
 
     auto interp = camera;
     interp.position += cameraVelocity * static_cast<float>(std::min(cameraUpdateScheduler.delta(), 1.0));
 
-    // Initialise shaders.
-    mainShader.use();
-    mainShader.uniformImage("FrameImage", frameImageIndex);
-    mainShader.uniformImages("BeamImage", beamLevels, beamImageIndices.data());
-    mainShader.uniformSampler("NoiseTexture", noiseTextureIndex);
-    mainShader.uniformSampler("MaxTexture", maxTextureIndex);
-    mainShader.uniformSampler("MinTexture", minTextureIndex);
-
-    mainShader.uniformUInt("FrameWidth", static_cast<GLuint>(frameWidth));
-    mainShader.uniformUInt("FrameHeight", static_cast<GLuint>(frameHeight));
-    mainShader.uniformBool("PathTracing", pathTracing);
-    mainShader.uniformBool("ProfilerOn", window.isKeyPressed(SDL_SCANCODE_M));
-
-    // See: https://en.cppreference.com/w/cpp/language/lifetime
-    // mainShader.uniformMat4("ProjectionMatrix", interp.projection().data());
-    // mainShader.uniformMat4("ModelViewMatrix", interp.modelView().data());
-    mainShader.uniformMat4("ProjectionInverse", interp.projection().inverted().data());
-    mainShader.uniformMat4("ModelViewInverse", interp.modelView().inverted().data());
-    mainShader.uniformVec3("CameraPosition", interp.position.x, interp.position.y, interp.position.z);
-    mainShader.uniformFloat("CameraFov", interp.fov * 3.14159265f / 180.0f);
-    // mainShader.uniformFloat("Time", static_cast<float>(UpdateScheduler::timeFromEpoch() - startTime));
-    mainShader.uniformFloat("RandomSeed", static_cast<float>(UpdateScheduler::timeFromEpoch() - startTime));
-
-    mainShader.uniformBool("DynamicMode", dynamicMode);
-    mainShader.uniformUInt("MaxNodes", static_cast<GLuint>(maxNodes));
-    mainShader.uniformUInt("MaxLevels", static_cast<GLuint>(worldLevels));
-    mainShader.uniformUInt("NoiseLevels", static_cast<GLuint>(noiseLevels));
-    mainShader.uniformUInt("PartialLevels", static_cast<GLuint>(partialLevels));
-    mainShader.uniformFloat("LodQuality", lodQuality);
+    // Stream chunks around the camera (never waits for generation).
+    if (chunkGrid) {
+      chunkGrid->update(interp.position.x, interp.position.z);
+      chunkGrid->upload(treeBuffer, chunkUploads);
+    }
+
+    // Seed primary rays with the previous frame's hits, reprojected into the current view.
+    // Both need depth, but reprojection assumes one sample per pixel, so it is off while upsampling.
+    auto const upsamplingActive = upsampling && !pathTracing;
+    auto const reprojectAvailable = reprojection && reprojectValid && !pathTracing && !upsamplingActive;
+
+    auto const submitStart = UpdateScheduler::timeFromEpoch();
+    if (profiler)
+      profiler->beginFrame();
+
+    // Initialise shaders: per-frame parameters go to the next uniform block slot, shared by all passes.
+    auto const projectionInverse = interp.projection().inverted(), modelViewInverse = interp.modelView().inverted();
+    auto const frameParamsFor = [&](Camera const& view) {
+      auto params = FrameParams();
+      std::copy_n(view.projection().inverted().data(), 16, params.projectionInverse.begin());
+      std::copy_n(view.modelView().inverted().data(), 16, params.modelViewInverse.begin());
+      params.cameraPosition = {view.position.x, view.position.y, view.position.z};
+      params.cameraFov = view.fov * 3.14159265f / 180.0f;
+      params.randomSeed = static_cast<float>(UpdateScheduler::timeFromEpoch() - startTime);
+      params.frameWidth = static_cast<uint32_t>(frameWidth);
+      params.frameHeight = static_cast<uint32_t>(frameHeight);
+      params.frameIndex = static_cast<uint32_t>(frameIndex);
+      params.maxNodes = static_cast<uint32_t>(maxNodes);
+      params.lodQuality = lodQuality;
+      params.boundsSize = boundsEnabled ? static_cast<uint32_t>(boundsSize) : 0u;
+      params.dynamicMode = dynamicMode;
+      params.infiniteMode = infiniteMode;
+      params.pathTracing = pathTracing;
+      params.profilerOn = window.isKeyPressed(SDL_SCANCODE_M);
+      params.reprojectAvailable = reprojectAvailable;
+      params.depthOutput = (reprojection || upsampling) && !pathTracing;
+      return params;
+    };
+    frameParams.push(frameParamsBlockIndex, frameParamsFor(interp));
+
+    auto const setGridUniforms = [&](ShaderProgram const& program) {
+      if (!chunkGrid)
+        return;
+      program.uniformUInt("GridSize", static_cast<GLuint>(chunkGrid->gridSize()));
+      program.uniformIVec2(
+        "GridOrigin",
+        static_cast<GLint>(chunkGrid->originX()),
+        static_cast<GLint>(chunkGrid->originZ())
+      );
+      program.uniformUVec2(
+        "GridOriginSlot",
+        static_cast<GLuint>(chunkGrid->originSlotX()),
+        static_cast<GLuint>(chunkGrid->originSlotZ())
+      );
+    };
 
     // See: https://www.khronos.org/opengl/wiki/Memory_Model#External_visibility
     auto barriers = GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT;
 
+    // Time the final pass of each candidate workgroup shape over a fixed sequence of views around the camera (best
+    // of several runs after a warm-up), then keep the fastest and save it to the configuration.
+    if (workgroupAutotunePending && !pathTracing) {
+      workgroupAutotunePending = false;
+      auto maxInvocations = GLint(0);
+      glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
+      auto timer = TimerQuery();
+      auto best = std::numeric_limits<uint64_t>::max();
+      auto bestProgram = std::optional<ShaderProgram>();
+      auto bestWidth = workgroupWidth, bestHeight = workgroupHeight;
+      for (auto const& [width, height]: workgroupCandidates) {
+        if (width * height > static_cast<size_t>(maxInvocations))
+          continue;
+        auto program = programCache.load(mainSources(width, height));
+        if (!program.linked())
+          continue;
+        initMainShader(program);
+        setGridUniforms(program);
+        program.uniformUInt("PrevBeamIndex", static_cast<GLuint>(beamCapacity));
+        program.uniformUInt("CurrBeamIndex", static_cast<GLuint>(beamCapacity));
+        program.uniformUInt("PrevBeamSize", 1);
+        program.uniformUInt("CurrBeamSize", 1);
+        auto elapsed = uint64_t(0);
+        for (auto i = 0uz; i < workgroupAutotuneViews; i++) {
+          auto view = interp;
+          auto const yaw = 360.0f * static_cast<float>(i) / static_cast<float>(workgroupAutotuneViews);
+          view.rotation = Vec3f(i % 2 == 0 ? 0.0f : -30.0f, yaw, 0.0f);
+          frameParams.push(frameParamsBlockIndex, frameParamsFor(view));
+          auto runs = std::numeric_limits<uint64_t>::max();
+          for (auto j = 0uz; j <= workgroupAutotuneFrames; j++) {
+            timer.begin();
+            glMemoryBarrier(barriers);
+            glDispatchCompute((frameWidth - 1) / width + 1, (frameHeight - 1) / height + 1, 1);
+            TimerQuery::end();
+            if (j > 0)
+              runs = std::min(runs, timer.result());
+          }
+          elapsed += runs;
+        }
+        std::stringstream ss;
+        ss << "Workgroup " << width << "x" << height << ": " << static_cast<double>(elapsed) / 1e6 << " ms.";
+        Log::verbose(ss.str());
+        if (elapsed < best) {
+          best = elapsed;
+          bestProgram = std::move(program);
+          bestWidth = width;
+          bestHeight = height;
+        }
+      }
+      frameParams.push(frameParamsBlockIndex, frameParamsFor(interp));
+      if (bestProgram) {
+        workgroupWidth = bestWidth;
+        workgroupHeight = bestHeight;
+        mainShader = std::move(*bestProgram);
+        initMainShader(mainShader);
+        resolveShader = programCache.load(resolveSources(workgroupWidth, workgroupHeight));
+        initResolveShader(resolveShader);
+        config.set("Render.WorkgroupWidth", workgroupWidth);
+        config.set("Render.WorkgroupHeight", workgroupHeight);
+        config.set("Render.WorkgroupAutotune", 0);
+        config.save(configPath() + configFilename());
+        std::stringstream ss;
+        ss << "Workgroup autotuning: using " << workgroupWidth << "x" << workgroupHeight << " (";
+        ss << static_cast<double>(best) / 1e6 << " ms over " << workgroupAutotuneViews << " views).";
+        Log::info(ss.str());
+      }
+    }
+
+    mainShader.use();
+    setGridUniforms(mainShader);
+
+    // Bake height bounds of cells that entered the windows.
+    if (boundsEnabled) {
+      for (auto level = 0uz; level < boundsLevels; level++) {
+        auto const cells = 1uz << level;
+        auto const maxOrigin = cells > boundsSize ? cells - boundsSize : 0uz;
+        auto const centre = [&](float x) {
+          auto const cell = static_cast<int64_t>(std::floor(x)) >> (treeLevels - level);
+          auto const origin = cell - static_cast<int64_t>(boundsSize / 2);
+          return static_cast<GLuint>(std::clamp<int64_t>(origin, 0, static_cast<int64_t>(maxOrigin)));
+        };
+        boundsOrigin[level * 2] = centre(interp.position.x);
+        boundsOrigin[level * 2 + 1] = centre(interp.position.z);
+      }
+      mainShader.uniformUVec2s("BoundsOrigin", boundsLevels, boundsOrigin.data());
+      if (!boundsPrevValid || boundsOrigin != boundsPrevOrigin) {
+        mainShader.uniformBool("BakeMode", true);
+        mainShader.uniformUVec2s("BoundsPrevOrigin", boundsLevels, boundsPrevOrigin.data());
+        mainShader.uniformBool("BoundsPrevValid", boundsPrevValid);
+        glMemoryBarrier(barriers);
+        profileBegin("bake");
+        glDispatchCompute(
+          (boundsSize - 1) / workgroupWidth + 1,
+          (boundsSize - 1) / workgroupHeight + 1,
+          boundsLevels
+        );
+        profileEnd();
+        mainShader.uniformBool("BakeMode", false);
+        boundsPrevOrigin = boundsOrigin;
+        boundsPrevValid = true;
+      }
+    }
+
+    // Expand nodes needed by the frame ahead of rendering, centre first, within the node budget.
+    mainShader.uniformBool("PregenMode", pregenEnabled);
+    if (pregenEnabled) {
+      auto const zero = uint32_t(0);
+      mainOutput.upload(offsetof(MainOutputData, pregenNodes), sizeof(zero), &zero);
+      mainShader.uniformUInt("PregenTiles", static_cast<GLuint>(pregenTiles));
+      mainShader.uniformUInt("PregenTileSize", static_cast<GLuint>(pregenTileSize));
+      mainShader.uniformUInt("PregenBudget", static_cast<GLuint>(pregenBudget));
+      // Full-resolution rays, regardless of what earlier passes left bound.
+      mainShader.uniformUInt("CurrBeamIndex", static_cast<GLuint>(beamCapacity));
+      mainShader.uniformUInt("CurrBeamSize", 1);
+      glMemoryBarrier(barriers);
+      profileBegin("pregen");
+      glDispatchCompute((pregenTiles - 1) / (workgroupWidth * workgroupHeight) + 1, 1, 1);
+      profileEnd();
+      mainShader.uniformBool("PregenMode", false);
+    }
+
+    // Reproject the previous frame's hits.
+    if (reprojectAvailable) {
+      glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+      profileBegin("reproject");
+      reprojectBuffer.fill(0xFFFFFFFFu);
+      mainShader.uniformBool("ReprojectMode", true);
+      mainShader.uniformMat4("ReprojectMatrix", (interp.projection() * interp.modelView()).data());
+      mainShader.uniformMat4("PrevProjectionInverse", prevCamera.projection().inverted().data());
+      mainShader.uniformMat4("PrevModelViewInverse", prevCamera.modelView().inverted().data());
+      mainShader.uniformVec3("PrevCameraPosition", prevCamera.position.x, prevCamera.position.y, prevCamera.position.z);
+      glMemoryBarrier(barriers);
+      glDispatchCompute((frameWidth - 1) / workgroupWidth + 1, (frameHeight - 1) / workgroupHeight + 1, 1);
+      profileEnd();
+      mainShader.uniformBool("ReprojectMode", false);
+    }
+
+    // Render beams, coarse to fine, and set up the final pass (`beamCapacity` means none).
+    auto const renderBeams = [&](std::vector<size_t> const& sizes) {
+      mainShader.uniformUInt("PrevBeamIndex", static_cast<GLuint>(beamCapacity));
+      mainShader.uniformUInt("PrevBeamSize", 1);
+      for (auto i = 0uz; i < sizes.size(); i++) {
+        auto const beamSize = sizes[i];
+        auto const currWidth = frameWidth / beamSize + 1;
+        auto const currHeight = frameHeight / beamSize + 1;
+        mainShader.uniformUInt("CurrBeamIndex", static_cast<GLuint>(i));
+        mainShader.uniformUInt("CurrBeamSize", static_cast<GLuint>(beamSize));
+        glMemoryBarrier(barriers);
+        profileBegin("beam " + std::to_string(beamSize));
+        glDispatchCompute((currWidth - 1) / workgroupWidth + 1, (currHeight - 1) / workgroupHeight + 1, 1);
+        profileEnd();
+        mainShader.uniformUInt("PrevBeamIndex", static_cast<GLuint>(i));
+        mainShader.uniformUInt("PrevBeamSize", static_cast<GLuint>(beamSize));
+      }
+      mainShader.uniformUInt("CurrBeamIndex", static_cast<GLuint>(beamCapacity));
+      mainShader.uniformUInt("CurrBeamSize", 1);
+    };
+
+    // Time candidate hierarchies on the current view (best of several runs after a warm-up) and keep the fastest.
+    if (beamAutotunePending && !pathTracing) {
+      beamAutotunePending = false;
+      auto timer = TimerQuery();
+      auto best = std::numeric_limits<uint64_t>::max();
+      for (auto const& sizes: beamCandidates(std::min(beamAutotuneLevels, beamCapacity))) {
+        reallocateBeams(sizes);
+        auto elapsed = std::numeric_limits<uint64_t>::max();
+        for (auto i = 0uz; i <= beamAutotuneFrames; i++) {
+          timer.begin();
+          renderBeams(sizes);
+          glMemoryBarrier(barriers);
+          glDispatchCompute((frameWidth - 1) / workgroupWidth + 1, (frameHeight - 1) / workgroupHeight + 1, 1);
+          TimerQuery::end();
+          if (i > 0)
+            elapsed = std::min(elapsed, timer.result());
+        }
+        if (elapsed < best) {
+          best = elapsed;
+          beamSizes = sizes;
+        }
+      }
+      reallocateBeams(beamSizes);
+      std::stringstream ss;
+      ss << "Beam autotuning at " << frameWidth << "x" << frameHeight << ": using `" << formatBeamSizes(beamSizes);
+      ss << "` (" << static_cast<double>(best) / 1e6 << " ms).";
+      Log::info(ss.str());
+    }
+
+    // Path tracing accumulates samples from the first frame (the camera does not move meanwhile).
+    mainShader.uniformUInt("AccumSamples", static_cast<GLuint>(accumSamples));
+    if (pathTracing && accumSamples == 0) {
+      auto const zero = uint32_t(0);
+      mainOutput.upload(offsetof(MainOutputData, converged), sizeof(zero), &zero);
+      mainOutputData.converged = 0;
+    }
+
     // Render scene, coarse to fine.
-    mainShader.uniformUInt("PrevBeamIndex", beamLevels);
-    mainShader.uniformUInt("PrevBeamSize", 1);
-    for (auto i = 0uz; i < beamLevels; i++) {
-      auto const beamSize = beamSizes[i];
-      auto const currWidth = frameWidth / beamSize + 1;
-      auto const currHeight = frameHeight / beamSize + 1;
-      mainShader.uniformUInt("CurrBeamIndex", static_cast<GLuint>(i));
-      mainShader.uniformUInt("CurrBeamSize", static_cast<GLuint>(beamSize));
+    if (resolution && !pathTracing)
+      resolution->begin();
+    renderBeams(beamSizes);
+    if (pathTracing && wavefront) {
+      // Each stage runs over a compacted queue, sized on the GPU for an indirect dispatch.
+      auto const stage = [&](WavefrontStage value) {
+        mainShader.uniformUInt("WavefrontStage", std::to_underlying(value));
+      };
+      auto const runQueue = [&](WavefrontStage value, WavefrontQueue queue, WavefrontQueue reset) {
+        profileBegin(value == WavefrontStage::extend ? "extend" : value == WavefrontStage::shade ? "shade" : "shadow");
+        stage(WavefrontStage::dispatch);
+        mainShader.uniformUInt("WavefrontQueue", std::to_underlying(queue));
+        mainShader.uniformUInt("WavefrontReset", std::to_underlying(reset));
+        glMemoryBarrier(barriers);
+        glDispatchCompute(1, 1, 1);
+        stage(value);
+        glMemoryBarrier(barriers | GL_COMMAND_BARRIER_BIT);
+        glDispatchComputeIndirect(offsetof(WavefrontHeader, dispatchArgs));
+        profileEnd();
+      };
+      // Bands are whole workgroup rows, so that ray generation does not spill into the next band.
+      auto const bandRows = wavefrontCapacity >= frameWidth * frameHeight
+                            ? frameHeight
+                            : std::max(wavefrontCapacity / frameWidth / workgroupHeight, 1uz) * workgroupHeight;
+      assert(bandRows * frameWidth <= wavefrontCapacity);
+      mainShader.uniformUInt("WavefrontCapacity", static_cast<GLuint>(wavefrontCapacity));
+      for (auto row = 0uz; row < frameHeight; row += bandRows) {
+        auto const header = WavefrontHeader();
+        wavefrontBuffer.upload(0, sizeof(header), &header);
+        mainShader.uniformUInt("WavefrontRowOffset", static_cast<GLuint>(row));
+        stage(WavefrontStage::raygen);
+        glMemoryBarrier(barriers);
+        profileBegin("raygen");
+        auto const rows = std::min(bandRows, frameHeight - row);
+        glDispatchCompute((frameWidth - 1) / workgroupWidth + 1, (rows - 1) / workgroupHeight + 1, 1);
+        profileEnd();
+        for (auto i = 0uz; i < maxTracedRays; i++) {
+          runQueue(WavefrontStage::extend, WavefrontQueue::paths, WavefrontQueue::hits);
+          runQueue(WavefrontStage::shade, WavefrontQueue::hits, WavefrontQueue::paths);
+        }
+        runQueue(WavefrontStage::shadow, WavefrontQueue::shadows, WavefrontQueue::none);
+      }
+      stage(WavefrontStage::accumulate);
       glMemoryBarrier(barriers);
-      glDispatchCompute((currWidth - 1) / workgroupWidth + 1, (currHeight - 1) / workgroupHeight + 1, 1);
-      mainShader.uniformUInt("PrevBeamIndex", static_cast<GLuint>(i));
-      mainShader.uniformUInt("PrevBeamSize", static_cast<GLuint>(beamSize));
+      profileBegin("accumulate");
+      glDispatchCompute((frameWidth - 1) / workgroupWidth + 1, (frameHeight - 1) / workgroupHeight + 1, 1);
+      profileEnd();
+      stage(WavefrontStage::off);
+    } else if (upsamplingActive) {
+      // Trace one jittered pixel per block, then reconstruct the others from the previous output.
+      auto const& jitter = upsampleJitters[frameIndex % upsampleJitters.size()];
+      auto const sampleWidth = (frameWidth - 1) / upsampleScale + 1;
+      auto const sampleHeight = (frameHeight - 1) / upsampleScale + 1;
+      mainShader.uniformUInt("CurrBeamSize", static_cast<GLuint>(upsampleScale));
+      mainShader.uniformUVec2("PixelJitter", jitter[0], jitter[1]);
+      glMemoryBarrier(barriers);
+      profileBegin("main");
+      glDispatchCompute((sampleWidth - 1) / workgroupWidth + 1, (sampleHeight - 1) / workgroupHeight + 1, 1);
+      profileEnd();
+      mainShader.uniformUVec2("PixelJitter", 0, 0);
+      frameRays = sampleWidth * sampleHeight;
+
+      auto& output = history[historyIndex];
+      history[historyIndex ^ 1].bindAt(historyTextureIndex);
+      glBindImageTexture(resolveImageIndex, output.handle(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+      resolveShader.use();
+      resolveShader.uniformBool("HistoryValid", historyValid);
+      resolveShader.uniformFloat("HistorySize", static_cast<float>(frameSize));
+      resolveShader.uniformUInt("FrameWidth", static_cast<GLuint>(frameWidth));
+      resolveShader.uniformUInt("FrameHeight", static_cast<GLuint>(frameHeight));
+      resolveShader.uniformUInt("SampleScale", static_cast<GLuint>(upsampleScale));
+      resolveShader.uniformUVec2("SampleJitter", jitter[0], jitter[1]);
+      resolveShader.uniformMat4("ProjectionInverse", projectionInverse.data());
+      resolveShader.uniformMat4("ModelViewInverse", modelViewInverse.data());
+      resolveShader.uniformVec3("CameraPosition", interp.position.x, interp.position.y, interp.position.z);
+      resolveShader.uniformMat4("PrevMatrix", (prevCamera.projection() * prevCamera.modelView()).data());
+      auto const& prevPosition = prevCamera.position;
+      resolveShader.uniformVec3("PrevCameraPosition", prevPosition.x, prevPosition.y, prevPosition.z);
+      glMemoryBarrier(barriers);
+      profileBegin("resolve");
+      glDispatchCompute((frameWidth - 1) / workgroupWidth + 1, (frameHeight - 1) / workgroupHeight + 1, 1);
+      profileEnd();
+      output.bindAt(resolvedTextureIndex);
+      historyIndex ^= 1;
+    } else {
+      glMemoryBarrier(barriers);
+      profileBegin("main");
+      glDispatchCompute((frameWidth - 1) / workgroupWidth + 1, (frameHeight - 1) / workgroupHeight + 1, 1);
+      profileEnd();
+      frameRays = frameWidth * frameHeight;
     }
-    mainShader.uniformUInt("CurrBeamIndex", beamLevels);
-    mainShader.uniformUInt("CurrBeamSize", 1);
-    glMemoryBarrier(barriers);
-    glDispatchCompute((frameWidth - 1) / workgroupWidth + 1, (frameHeight - 1) / workgroupHeight + 1, 1);
+    if (resolution && !pathTracing)
+      resolution->end();
+    if (pathTracing) {
+      // Converged pixels are no longer traced (as of the last readback).
+      auto const pixels = frameWidth * frameHeight;
+      sampleCounter += pixels - std::min(static_cast<size_t>(mainOutputData.converged), pixels);
+      accumSamples++;
+    }
+    reprojectValid = reprojection && !pathTracing;
+    historyValid = upsamplingActive;
+    prevCamera = interp;
+
+    // Reclaim node groups not reached recently, or finer than the current view needs (same as `main.csh`).
+    if (dynamicMode && pruneInterval > 0 && frameIndex % pruneInterval == 0) {
+      // The inverse view rotation; the projection is centred on `-z`.
+      auto const viewDir = interp.transformedVelocity(Vec3f(0.0f, 0.0f, -1.0f));
+      auto const fov = interp.fov * 3.14159265f / 180.0f;
+      pruneShader.use();
+      pruneShader.uniformUInt("FrameIndex", static_cast<GLuint>(frameIndex));
+      pruneShader.uniformUInt("MaxAge", static_cast<GLuint>(pruneAge));
+      pruneShader.uniformUInt("MaxLevels", static_cast<GLuint>(treeLevels));
+      pruneShader.uniformVec3(
+        "LodCenterPos",
+        std::floor(interp.position.x) + 0.5f,
+        std::floor(interp.position.y) + 0.5f,
+        std::floor(interp.position.z) + 0.5f
+      );
+      pruneShader.uniformVec3("LodViewDir", viewDir.x, viewDir.y, viewDir.z);
+      pruneShader.uniformFloat("LodScale", std::tan(fov / 2.0f) * 2.0f / static_cast<float>(frameHeight) / lodQuality);
+      pruneShader.uniformFloat("LodFactor", pruneLodFactor);
+      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+      profileBegin("prune");
+      glDispatchCompute(pruneWorkgroups, 1, 1);
+      profileEnd();
+    }
+
+    // Check the tree between frames (after pruning, so that freed groups are not counted).
+    if (!infiniteMode && !childMasks) {
+      auto const now = UpdateScheduler::timeFromEpoch();
+      if (treeStatsInterval > 0.0 && now - treeStatsTime >= treeStatsInterval)
+        treeStatsRequested = true;
+      if (treeStatsRequested && !(treeStats && treeStats->pending())) {
+        if (!treeStats) {
+          auto const nodes = std::min(treeBuffer.size() / sizeof(uint32_t), treeStatsMaxNodes);
+          treeStats.emplace(programCache.load({{OpenGL::computeShader, shaderPath() + "treestats.csh"}}), nodes);
+        }
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        profileBegin("tree stats");
+        treeStats->run(treeLevels);
+        profileEnd();
+        treeStatsRequested = false;
+        treeStatsTime = now;
+      }
+      if (treeStats)
+        if (auto const result = treeStats->poll())
+          TreeStatistics::log(*result);
+    }
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    mainOutputReadback.copy(mainOutput);
+    frameIndex++;
+    submitTime += UpdateScheduler::timeFromEpoch() - submitStart;
+
+    // Capture the frame being presented.
+    if (screenshotRequested || recording) {
+      if (!frameCapture)
+        frameCapture.emplace(captureSlots, captureWorkers);
+      auto const& source = upsamplingActive ? history[historyIndex ^ 1] : frame;
+      if (screenshotRequested) {
+        std::stringstream ss;
+        ss << screenshotPath() << frameWidth << "x" << frameHeight << "-" << accumSamples << "spp-"
+           << UpdateScheduler::timeFromEpoch() - startTime << "s.bmp";
+        // Retried next frame if all slots are busy.
+        screenshotRequested = !frameCapture->capture(source, frameWidth, frameHeight, ss.str(), true);
+        if (!screenshotRequested)
+          Log::info("Saving screenshot `" + ss.str() + "`.");
+      }
+      if (recording) {
+        std::stringstream ss;
+        // Numbered consecutively even if frames are dropped, as expected by video encoders.
+        ss << recordingPath << std::setw(6) << std::setfill('0') << recordingFrame << ".bmp";
+        if (frameCapture->capture(source, frameWidth, frameHeight, ss.str()))
+          recordingFrame++;
+      }
+    }
+    if (frameCapture)
+      frameCapture->update();
 
     gl.setDrawArea(0, 0, window.width(), window.height());
     gl.clear();
 
     // Present to screen.
     basicShader.use();
-    basicShader.uniformSampler("Texture2D", frameTextureIndex);
+    basicShader.uniformSampler("Texture2D", upsamplingActive ? resolvedTextureIndex : frameTextureIndex);
     basicShader.uniformBool("Texture2DEnabled", true);
     basicShader.uniformBool("ColorEnabled", false);
     basicShader.uniformBool("GammaConversion", true);
     glMemoryBarrier(barriers);
+    profileBegin("present");
     quad.draw();
+    profileEnd();
 
     window.swapBuffers();
     gl.checkError();
@@ -0,0 +1,86 @@
+#include "mappedbuffer.h"
+#include <cstdlib>
+#include "common.h"
+#include "log.h"
+
+#ifdef VXRT_TARGET_POSIX
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+MappedBuffer::MappedBuffer(std::string const& path) {
+#ifdef VXRT_TARGET_POSIX
+  mFile = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (mFile < 0) {
+    Log::warning("Could not open storage file `" + path + "`, falling back to memory.");
+    return;
+  }
+  // The file is only reachable through the descriptor from now on, and is removed when it is closed.
+  unlink(path.c_str());
+#else
+  Log::warning("File-backed storage is not supported on this platform, falling back to memory.");
+#endif
+}
+
+MappedBuffer::~MappedBuffer() noexcept {
+#ifdef VXRT_TARGET_POSIX
+  if (mFile >= 0) {
+    if (mPtr)
+      munmap(mPtr, mSize);
+    close(mFile);
+    return;
+  }
+#endif
+  std::free(mPtr);
+}
+
+void MappedBuffer::reallocate(size_t size) {
+#ifdef VXRT_TARGET_POSIX
+  if (mFile >= 0) {
+    // Extending the file leaves a hole, so untouched space takes no disk blocks.
+    if (mPtr)
+      munmap(mPtr, mSize);
+    mPtr = nullptr;
+    mSize = 0;
+    if (size == 0)
+      return;
+    if (ftruncate(mFile, static_cast<off_t>(size)) != 0) {
+      Log::fatal("Could not resize storage file (out of disk space?).");
+      std::abort();
+    }
+    auto const ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mFile, 0);
+    if (ptr == MAP_FAILED) {
+      Log::fatal("Could not map storage file.");
+      std::abort();
+    }
+    mPtr = ptr;
+    mSize = size;
+    return;
+  }
+#endif
+  auto const ptr = std::realloc(mPtr, size);
+  if (!ptr && size != 0) {
+    Log::fatal("Out of memory.");
+    std::abort();
+  }
+  mPtr = ptr;
+  mSize = size;
+}
+
+void MappedBuffer::advise([[maybe_unused]] size_t offset, [[maybe_unused]] size_t size, [[maybe_unused]] Advice advice)
+  const {
+#ifdef VXRT_TARGET_POSIX
+  if (mFile < 0 || size == 0)
+    return;
+  assert(offset + size <= mSize);
+  // Ranges must start at a page boundary.
+  auto const page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  auto const begin = offset / page * page;
+  auto const flag = advice == Advice::sequential ? MADV_SEQUENTIAL
+                  : advice == Advice::willNeed   ? MADV_WILLNEED
+                  : advice == Advice::dontNeed   ? MADV_DONTNEED
+                                                 : MADV_NORMAL;
+  madvise(static_cast<char*>(mPtr) + begin, offset + size - begin, flag);
+#endif
+}
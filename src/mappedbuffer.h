@@ -0,0 +1,145 @@
+#ifndef MAPPEDBUFFER_H_
+#define MAPPEDBUFFER_H_
+
+#include <algorithm>
+#include <cassert>
+#include <concepts>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+// A growable block of memory, optionally backed by a sparse memory-mapped file, so that its contents can exceed
+// physical memory and are paged in and out by the OS. The file is scratch storage: it is unlinked as soon as it
+// is opened. Without a path (or on non-POSIX targets), falls back to ordinary heap memory.
+class MappedBuffer {
+public:
+  enum class Advice { normal, sequential, willNeed, dontNeed };
+
+  MappedBuffer() = default;
+  explicit MappedBuffer(std::string const& path);
+  ~MappedBuffer() noexcept;
+
+  MappedBuffer(MappedBuffer&& r) noexcept:
+      mFile(std::exchange(r.mFile, -1)),
+      mPtr(std::exchange(r.mPtr, nullptr)),
+      mSize(std::exchange(r.mSize, 0)) {}
+
+  MappedBuffer& operator=(MappedBuffer&& r) noexcept {
+    swap(*this, r);
+    return *this;
+  }
+
+  friend void swap(MappedBuffer& l, MappedBuffer& r) noexcept {
+    using std::swap;
+    swap(l.mFile, r.mFile);
+    swap(l.mPtr, r.mPtr);
+    swap(l.mSize, r.mSize);
+  }
+
+  bool fileBacked() const { return mFile >= 0; }
+  void* get() const { return mPtr; }
+  size_t size() const { return mSize; }
+
+  // Resizes storage, preserving existing contents. New bytes are unspecified.
+  void reallocate(size_t size);
+
+  // Hints the expected access pattern of a byte range.
+  void advise(size_t offset, size_t size, Advice advice) const;
+
+private:
+  int mFile = -1;
+  void* mPtr = nullptr;
+  size_t mSize = 0;
+};
+
+static_assert(std::move_constructible<MappedBuffer>);
+static_assert(std::assignable_from<MappedBuffer&, MappedBuffer&&>);
+
+// A `std::vector`-like array of trivially copyable elements on top of `MappedBuffer`.
+// Like `std::vector`, references are invalidated when capacity grows.
+template <typename T>
+requires std::is_trivially_copyable_v<T>
+class MappedVector {
+public:
+  using Advice = MappedBuffer::Advice;
+
+  MappedVector() = default;
+  explicit MappedVector(std::string const& path):
+      mBuffer(path) {}
+
+  MappedVector(MappedVector&& r) noexcept:
+      mBuffer(std::move(r.mBuffer)),
+      mSize(std::exchange(r.mSize, 0)) {}
+
+  MappedVector& operator=(MappedVector&& r) noexcept {
+    swap(*this, r);
+    return *this;
+  }
+
+  friend void swap(MappedVector& l, MappedVector& r) noexcept {
+    using std::swap;
+    swap(l.mBuffer, r.mBuffer);
+    swap(l.mSize, r.mSize);
+  }
+
+  bool fileBacked() const { return mBuffer.fileBacked(); }
+  size_t size() const { return mSize; }
+  bool empty() const { return mSize == 0; }
+  size_t capacity() const { return mBuffer.size() / sizeof(T); }
+  T* data() { return static_cast<T*>(mBuffer.get()); }
+  T const* data() const { return static_cast<T const*>(mBuffer.get()); }
+  T* begin() { return data(); }
+  T* end() { return data() + mSize; }
+  T const* begin() const { return data(); }
+  T const* end() const { return data() + mSize; }
+
+  T& operator[](size_t i) {
+    assert(i < mSize);
+    return data()[i];
+  }
+
+  T const& operator[](size_t i) const {
+    assert(i < mSize);
+    return data()[i];
+  }
+
+  void reserve(size_t count) {
+    if (count > capacity())
+      mBuffer.reallocate(count * sizeof(T));
+  }
+
+  // New elements are value-initialised (zeroed).
+  void resize(size_t count) {
+    if (count > capacity())
+      reserve(std::max(count, capacity() * 2));
+    if (count > mSize)
+      std::memset(static_cast<void*>(data() + mSize), 0, (count - mSize) * sizeof(T));
+    mSize = count;
+  }
+
+  // Like `resize()`, but new elements are unspecified and left untouched, so that growing file-backed storage only
+  // extends the file (see `MappedBuffer::reallocate()`) and pages are only faulted in when written.
+  void resizeUninitialized(size_t count) {
+    if (count > capacity())
+      reserve(std::max(count, capacity() * 2));
+    mSize = count;
+  }
+
+  void push_back(T const& value) {
+    resize(mSize + 1);
+    data()[mSize - 1] = value;
+  }
+
+  void clear() { mSize = 0; }
+
+  void advise(size_t first, size_t count, Advice advice) const {
+    mBuffer.advise(first * sizeof(T), count * sizeof(T), advice);
+  }
+
+private:
+  MappedBuffer mBuffer;
+  size_t mSize = 0;
+};
+
+#endif // MAPPEDBUFFER_H_
@@ -0,0 +1,92 @@
+#include "profiler.h"
+#include <algorithm>
+#include <cassert>
+#include <sstream>
+#include "log.h"
+
+Profiler::Profiler(size_t window, std::string const& tracePath):
+    mWindow(std::max(window, 1uz)) {
+  if (!tracePath.empty()) {
+    mTrace.open(tracePath);
+    if (mTrace)
+      mTrace << "frame,pass,ms\n";
+    else
+      Log::warning("Could not open profiler trace file: " + tracePath);
+  }
+}
+
+void Profiler::beginFrame() {
+  assert(!mActive);
+  for (auto& frame: mFrames)
+    collect(frame);
+  if (mRecording)
+    mCurr = (mCurr + 1) % ringSize;
+  // The oldest frame is reused: drop it if it is still in flight.
+  auto& frame = mFrames[mCurr];
+  frame.passes.clear();
+  frame.index = mFrameIndex++;
+  mRecording = true;
+}
+
+void Profiler::begin(std::string const& pass) {
+  assert(mRecording && !mActive);
+  auto [it, inserted] = mPasses.try_emplace(pass, mNames.size());
+  if (inserted) {
+    mNames.push_back(pass);
+    mSamples.emplace_back();
+  }
+  auto& frame = mFrames[mCurr];
+  auto const query = frame.passes.size() * 2;
+  if (frame.queries.size() < query + 2)
+    frame.queries.resize(query + 2);
+  frame.passes.push_back(it->second);
+  frame.queries[query].timestamp();
+  mActive = true;
+}
+
+void Profiler::end() {
+  assert(mActive);
+  auto& frame = mFrames[mCurr];
+  frame.queries[frame.passes.size() * 2 - 1].timestamp();
+  mActive = false;
+}
+
+void Profiler::collect(Frame& frame) {
+  if (frame.passes.empty() || !frame.queries[frame.passes.size() * 2 - 1].available())
+    return;
+  for (auto i = 0uz; i < frame.passes.size(); i++) {
+    auto const begin = frame.queries[i * 2].result(), end = frame.queries[i * 2 + 1].result();
+    auto const ms = static_cast<double>(end - begin) / 1e6;
+    auto& samples = mSamples[frame.passes[i]];
+    samples.push_back(ms);
+    if (samples.size() > mWindow)
+      samples.pop_front();
+    if (mTrace)
+      mTrace << frame.index << "," << mNames[frame.passes[i]] << "," << ms << "\n";
+  }
+  frame.passes.clear();
+}
+
+void Profiler::dump() const {
+  std::stringstream ss;
+  ss << "GPU time per pass (ms, last " << mWindow << " samples):";
+  auto total = 0.0;
+  for (auto i = 0uz; i < mNames.size(); i++) {
+    if (mSamples[i].empty())
+      continue;
+    auto sorted = std::vector<double>(mSamples[i].begin(), mSamples[i].end());
+    std::ranges::sort(sorted);
+    auto const percentile = [&](double p) {
+      return sorted[std::min(static_cast<size_t>(p * static_cast<double>(sorted.size())), sorted.size() - 1)];
+    };
+    auto sum = 0.0;
+    for (auto ms: sorted)
+      sum += ms;
+    auto const average = sum / static_cast<double>(sorted.size());
+    total += average;
+    ss << "\n  " << mNames[i] << ": avg " << average << ", p50 " << percentile(0.5) << ", p95 " << percentile(0.95);
+    ss << ", p99 " << percentile(0.99) << ", max " << sorted.back() << " (" << sorted.size() << " samples)";
+  }
+  ss << "\n  Total (avg): " << total;
+  Log::info(ss.str());
+}
@@ -0,0 +1,55 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <array>
+#include <concepts>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "timerquery.h"
+
+// GPU time of named passes, from a pair of timestamp queries around each. Queries of the last few frames are kept in
+// a ring and read back once available, so that reading never stalls (frames that are still not ready when their slot
+// is reused are dropped). Keeps a rolling window of samples per pass, and can append every sample to a CSV trace.
+class Profiler {
+public:
+  // With an empty `tracePath`, no trace is written.
+  explicit Profiler(size_t window = 240, std::string const& tracePath = "");
+
+  // Reads back finished frames and starts recording a new one.
+  void beginFrame();
+
+  // Brackets a pass. Passes must not overlap.
+  void begin(std::string const& pass);
+  void end();
+
+  // Logs the average and percentiles of each pass over the window, in order of first appearance.
+  void dump() const;
+
+private:
+  static constexpr auto ringSize = 4uz;
+
+  struct Frame {
+    size_t index = 0;
+    std::vector<size_t> passes; // Pass of each query pair.
+    std::vector<TimerQuery> queries; // Begin and end timestamps (grows as needed, reused across frames.)
+  };
+
+  size_t mWindow;
+  std::ofstream mTrace;
+  std::array<Frame, ringSize> mFrames;
+  size_t mCurr = 0, mFrameIndex = 0;
+  bool mRecording = false, mActive = false;
+  std::vector<std::string> mNames;
+  std::unordered_map<std::string, size_t> mPasses;
+  std::vector<std::deque<double>> mSamples; // In milliseconds, most recent last.
+
+  // Reads back a frame if its queries are available, then clears it.
+  void collect(Frame& frame);
+};
+
+static_assert(std::move_constructible<Profiler>);
+
+#endif // PROFILER_H_
@@ -0,0 +1,87 @@
+#include "programcache.h"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <sstream>
+#include "log.h"
+
+ShaderProgram ProgramCache::load(std::vector<ShaderSource> const& sources) const {
+  // Key: driver and preprocessed sources.
+  auto key = std::string();
+  for (auto name: {GL_VENDOR, GL_RENDERER, GL_VERSION})
+    key += reinterpret_cast<char const*>(glGetString(name)) + std::string(1, '\0');
+  auto texts = std::vector<std::string>();
+  for (auto const& source: sources) {
+    auto text = ShaderStage::load(source.filename, source.defines);
+    if (!text)
+      Log::error("Could not open shader file: " + source.filename);
+    texts.push_back(text.value_or(""));
+    key += std::to_string(source.stage) + '\0' + texts.back() + '\0';
+  }
+  auto path = std::string();
+  if (!mDirectory.empty()) {
+    std::stringstream ss;
+    ss << mDirectory << std::hex << std::hash<std::string>{}(key) << ".bin";
+    path = ss.str();
+  }
+
+  // File: key size (8 bytes), the full key, format (4 bytes), then the binary. Files are named by a hash of the
+  // key, so the stored key is compared to reject collisions.
+  if (!path.empty()) {
+    std::ifstream ifs(path, std::ios::binary);
+    auto size = uint64_t(0);
+    auto format = GLenum(0);
+    if (ifs.read(reinterpret_cast<char*>(&size), sizeof(size)) && size == key.size()) {
+      auto stored = std::string(size, '\0');
+      if (ifs.read(stored.data(), static_cast<std::streamsize>(size)) && stored == key &&
+          ifs.read(reinterpret_cast<char*>(&format), sizeof(format))) {
+        auto const data = std::vector<char>(std::istreambuf_iterator<char>(ifs), {});
+        if (auto res = ShaderProgram::fromBinary(format, data))
+          return std::move(*res);
+        Log::info("Cached program rejected by the driver, rebuilding: " + path);
+      } else {
+        Log::info("Cached program built from other sources, rebuilding: " + path);
+      }
+    }
+  }
+
+  auto stages = std::vector<ShaderStage>();
+  for (auto i = 0uz; i < sources.size(); i++)
+    stages.push_back(ShaderStage::fromSource(sources[i].stage, texts[i], sources[i].filename));
+  auto res = ShaderProgram(stages);
+  if (!path.empty() && res.linked()) {
+    auto format = GLenum(0);
+    auto const data = res.binary(format);
+    auto ec = std::error_code();
+    std::filesystem::create_directories(mDirectory, ec);
+    std::ofstream ofs(path, std::ios::binary);
+    if (!data.empty() && ofs) {
+      auto const size = static_cast<uint64_t>(key.size());
+      ofs.write(reinterpret_cast<char const*>(&size), sizeof(size));
+      ofs.write(key.data(), static_cast<std::streamsize>(key.size()));
+      ofs.write(reinterpret_cast<char const*>(&format), sizeof(format));
+      ofs.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+  }
+  return res;
+}
+
+std::future<ShaderProgram> ProgramCache::loadAsync(Window const& window, std::vector<ShaderSource> sources) const {
+  auto const shared = window.createSharedContext();
+  if (!shared) {
+    auto promise = std::promise<ShaderProgram>();
+    promise.set_value(load(sources));
+    return promise.get_future();
+  }
+  return std::async(std::launch::async, [cache = *this, shared = *shared, sources] {
+    SDL_GL_MakeCurrent(shared.window, shared.context);
+    auto res = cache.load(sources);
+    // Complete all commands before the program is used from another context.
+    glFinish();
+    SDL_GL_MakeCurrent(shared.window, nullptr);
+    SDL_GL_DeleteContext(shared.context);
+    return res;
+  });
+}
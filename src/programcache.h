@@ -0,0 +1,38 @@
+#ifndef PROGRAMCACHE_H_
+#define PROGRAMCACHE_H_
+
+#include <future>
+#include <string>
+#include <vector>
+#include "opengl.h"
+#include "shader.h"
+#include "window.h"
+
+// A shader stage of a program loaded through `ProgramCache`.
+struct ShaderSource {
+  OpenGL::ShaderStage stage;
+  std::string filename;
+  std::string defines = "";
+};
+
+// Caches linked program binaries on disk (`glGetProgramBinary`), keyed by a hash of the preprocessed sources
+// (including defines) and the driver. The full key is stored with the binary and checked on load, so that a hash
+// collision rebuilds the program. Binaries rejected by the driver are rebuilt and replaced.
+// With an empty directory, programs are always compiled.
+class ProgramCache {
+public:
+  explicit ProgramCache(std::string directory = ""):
+      mDirectory(std::move(directory)) {}
+
+  // Loads or builds a program on the calling thread, which must have a current context.
+  ShaderProgram load(std::vector<ShaderSource> const& sources) const;
+
+  // Like `load()`, but on a worker thread with a context shared with `window`'s, so that the caller can go on
+  // meanwhile. The program can be used by any shared context once ready.
+  std::future<ShaderProgram> loadAsync(Window const& window, std::vector<ShaderSource> sources) const;
+
+private:
+  std::string mDirectory;
+};
+
+#endif // PROGRAMCACHE_H_
@@ -0,0 +1,51 @@
+#include "resolutioncontroller.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+ResolutionController::ResolutionController(double targetMs, double minScale, double maxScale):
+    mTargetMs(targetMs),
+    mMinScale(minScale),
+    mMaxScale(maxScale),
+    mScale(maxScale) {
+  assert(targetMs > 0.0 && minScale > 0.0 && minScale <= maxScale);
+}
+
+void ResolutionController::begin() {
+  assert(!mActive);
+  if (mPending == ringSize)
+    return;
+  mQueries[(mFirst + mPending) % ringSize].begin();
+  mActive = true;
+}
+
+void ResolutionController::end() {
+  if (!mActive)
+    return;
+  TimerQuery::end();
+  mPending++;
+  mActive = false;
+}
+
+void ResolutionController::update() {
+  auto updated = false;
+  while (mPending > 0 && mQueries[mFirst].available()) {
+    auto const ms = static_cast<double>(mQueries[mFirst].result()) / 1e6;
+    mFrameTime = mFrameTime > 0.0 ? mFrameTime * 0.8 + ms * 0.2 : ms;
+    mFirst = (mFirst + 1) % ringSize;
+    mPending--;
+    updated = true;
+  }
+  if (!updated || mFrameTime <= 0.0)
+    return;
+
+  // Move halfway to the estimated scale, ignoring differences within 5%.
+  auto const desired = std::clamp(mScale * std::sqrt(mTargetMs / mFrameTime), mMinScale, mMaxScale);
+  auto const bounded = desired == mMinScale || desired == mMaxScale;
+  if (desired == mScale || (!bounded && std::abs(desired - mScale) <= mScale * 0.05))
+    return;
+  auto const next = std::abs(desired - mScale) < 0.01 ? desired : mScale + (desired - mScale) * 0.5;
+  // Timings still in flight were taken at the old scale; rescale the estimate accordingly.
+  mFrameTime *= (next * next) / (mScale * mScale);
+  mScale = next;
+}
@@ -0,0 +1,37 @@
+#ifndef RESOLUTIONCONTROLLER_H_
+#define RESOLUTIONCONTROLLER_H_
+
+#include <array>
+#include <concepts>
+#include "timerquery.h"
+
+// Chooses a render resolution scale so that GPU time of the timed passes approaches a target.
+// Timings are read back a few frames late without stalling; the scale changes in damped steps, with hysteresis,
+// assuming time is proportional to the number of pixels.
+class ResolutionController {
+public:
+  ResolutionController(double targetMs, double minScale, double maxScale);
+
+  double scale() const { return mScale; }
+  double frameTime() const { return mFrameTime; } // Smoothed, in milliseconds.
+
+  // Brackets the passes to be timed. Frames are skipped while all queries are in flight.
+  void begin();
+  void end();
+
+  // Reads finished timings and updates the scale.
+  void update();
+
+private:
+  static constexpr auto ringSize = 4uz;
+
+  double mTargetMs, mMinScale, mMaxScale;
+  double mScale, mFrameTime = 0.0;
+  std::array<TimerQuery, ringSize> mQueries;
+  size_t mFirst = 0, mPending = 0;
+  bool mActive = false;
+};
+
+static_assert(std::move_constructible<ResolutionController>);
+
+#endif // RESOLUTIONCONTROLLER_H_
@@ -5,22 +5,38 @@
 #include <vector>
 #include "log.h"
 
-ShaderStage::ShaderStage(OpenGL::ShaderStage stage, std::string const& filename):
+ShaderStage::ShaderStage(OpenGL::ShaderStage stage, std::string const& filename, std::string const& defines):
     mStage(stage) {
-  // Load shader source.
-  std::ifstream ifs(filename);
-  if (!ifs.is_open()) {
+  auto const source = load(filename, defines);
+  if (!source) {
     Log::error("Could not open shader file: " + filename);
     return;
   }
+  compile(*source, filename);
+}
+
+std::optional<std::string> ShaderStage::load(std::string const& filename, std::string const& defines) {
+  std::ifstream ifs(filename);
+  if (!ifs.is_open())
+    return {};
   std::string source;
-  while (!ifs.eof()) {
+  for (auto first = true; !ifs.eof(); first = false) {
     std::string line;
     std::getline(ifs, line);
     source += line + '\n';
+    if (first)
+      source += defines;
   }
+  return source;
+}
+
+ShaderStage ShaderStage::fromSource(OpenGL::ShaderStage stage, std::string const& source, std::string const& name) {
+  auto res = ShaderStage(stage);
+  res.compile(source, name);
+  return res;
+}
 
-  // Compile shader.
+void ShaderStage::compile(std::string const& source, std::string const& name) {
   mHandle = glCreateShader(mStage);
   char const* str = source.c_str();
   glShaderSource(mHandle, 1, &str, nullptr);
@@ -34,7 +50,7 @@ ShaderStage::ShaderStage(OpenGL::ShaderStage stage, std::string const& filename)
     glGetShaderiv(mHandle, GL_INFO_LOG_LENGTH, &infoLogLength);
     std::string infoLog(static_cast<size_t>(infoLogLength), ' ');
     glGetShaderInfoLog(mHandle, infoLogLength, &charsWritten, infoLog.data());
-    Log::error("OpenGL shader stage compilation error: " + filename + ":\n" + infoLog);
+    Log::error("OpenGL shader stage compilation error: " + name + ":\n" + infoLog);
   }
 }
 
@@ -43,11 +59,12 @@ ShaderStage::~ShaderStage() noexcept {
     glDeleteShader(mHandle);
 }
 
-ShaderProgram::ShaderProgram(std::initializer_list<ShaderStage> stages) {
-  // Link shader stages.
+ShaderProgram::ShaderProgram(std::span<ShaderStage const> stages) {
+  // Link shader stages (keeping the binary available for `binary()`).
   mHandle = glCreateProgram();
   for (auto const& stage: stages)
     glAttachShader(mHandle, stage.handle());
+  glProgramParameteri(mHandle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
   glLinkProgram(mHandle);
 
   // Check if linking is successful.
@@ -65,6 +82,13 @@ ShaderProgram::ShaderProgram(std::initializer_list<ShaderStage> stages) {
   // See: https://www.khronos.org/opengl/wiki/Shader_Compilation
   for (auto const& stage: stages)
     glDetachShader(mHandle, stage.handle());
+
+  cacheLocations();
+}
+
+ShaderProgram::ShaderProgram(OpenGL::Object handle):
+    mHandle(handle) {
+  cacheLocations();
 }
 
 ShaderProgram::~ShaderProgram() noexcept {
@@ -72,9 +96,60 @@ ShaderProgram::~ShaderProgram() noexcept {
     glDeleteProgram(mHandle);
 }
 
+std::optional<ShaderProgram> ShaderProgram::fromBinary(GLenum format, std::vector<char> const& data) {
+  auto handle = glCreateProgram();
+  glProgramBinary(handle, format, data.data(), static_cast<GLsizei>(data.size()));
+  GLint success = GL_FALSE;
+  glGetProgramiv(handle, GL_LINK_STATUS, &success);
+  if (success == GL_FALSE) {
+    glDeleteProgram(handle);
+    return {};
+  }
+  return ShaderProgram(handle);
+}
+
+bool ShaderProgram::linked() const {
+  GLint success = GL_FALSE;
+  if (mHandle != OpenGL::null)
+    glGetProgramiv(mHandle, GL_LINK_STATUS, &success);
+  return success != GL_FALSE;
+}
+
+std::vector<char> ShaderProgram::binary(GLenum& format) const {
+  GLint length = 0;
+  glGetProgramiv(mHandle, GL_PROGRAM_BINARY_LENGTH, &length);
+  auto res = std::vector<char>(static_cast<size_t>(length));
+  if (length > 0) {
+    glGetProgramBinary(mHandle, length, &length, &format, res.data());
+    res.resize(static_cast<size_t>(length));
+  }
+  return res;
+}
+
+void ShaderProgram::cacheLocations() {
+  // Cache uniform locations (arrays can also be named without the `[0]` suffix).
+  GLint count = 0, maxLength = 0;
+  glGetProgramiv(mHandle, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(mHandle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+  auto buffer = std::string(static_cast<size_t>(maxLength), '\0');
+  for (auto i = 0; i < count; i++) {
+    GLsizei length = 0;
+    glGetActiveUniformName(mHandle, static_cast<GLuint>(i), maxLength, &length, buffer.data());
+    auto name = buffer.substr(0, static_cast<size_t>(length));
+    auto const loc = glGetUniformLocation(mHandle, name.c_str());
+    if (loc == -1)
+      continue; // Uniform block member.
+    if (name.ends_with("[0]"))
+      mLocations.emplace(name.substr(0, name.size() - 3), loc);
+    mLocations.emplace(std::move(name), loc);
+  }
+}
+
 OpenGL::UniformLocation ShaderProgram::uniformLocation(std::string const& name) const {
-  auto loc = glGetUniformLocation(mHandle, name.c_str());
-  if (loc == -1)
-    Log::verbose("Specifying unused uniform variable: " + name);
-  return loc;
+  auto const it = mLocations.find(name);
+  if (it != mLocations.end())
+    return it->second;
+  Log::verbose("Specifying unused uniform variable: " + name);
+  mLocations.emplace(name, -1);
+  return -1;
 }
@@ -3,15 +3,49 @@
 
 #include <concepts>
 #include <initializer_list>
+#include <map>
+#include <optional>
+#include <span>
 #include <string>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 #include "opengl.h"
 
+// `#define`s injected into shader sources. Kept sorted, so that equal sets give equal sources (and cache keys).
+class ShaderDefines {
+public:
+  ShaderDefines& set(std::string const& name, std::string const& value = "") {
+    mValues[name] = value;
+    return *this;
+  }
+
+  // Defines an unsigned integer constant.
+  ShaderDefines& set(std::string const& name, size_t value) { return set(name, std::to_string(value) + "u"); }
+
+  std::string str() const {
+    auto res = std::string();
+    for (auto const& [name, value]: mValues)
+      res += "#define " + name + (value.empty() ? "" : " " + value) + "\n";
+    return res;
+  }
+
+private:
+  std::map<std::string, std::string> mValues;
+};
+
 class ShaderStage {
 public:
-  ShaderStage(OpenGL::ShaderStage stage, std::string const& filename);
+  // `defines` is inserted after the `#version` line of the source.
+  ShaderStage(OpenGL::ShaderStage stage, std::string const& filename, std::string const& defines = "");
   ~ShaderStage() noexcept;
 
+  // Returns the source of `filename` with `defines` inserted, or nothing if it cannot be read.
+  static std::optional<std::string> load(std::string const& filename, std::string const& defines = "");
+
+  // Compiles a source returned by `load()`; `name` is used in error messages.
+  static ShaderStage fromSource(OpenGL::ShaderStage stage, std::string const& source, std::string const& name);
+
   ShaderStage(ShaderStage&& r) noexcept:
       mStage(r.mStage),
       mHandle(std::exchange(r.mHandle, OpenGL::null)) {}
@@ -33,6 +67,11 @@ public:
 private:
   OpenGL::ShaderStage mStage;
   OpenGL::Object mHandle = OpenGL::null;
+
+  explicit ShaderStage(OpenGL::ShaderStage stage):
+      mStage(stage) {}
+
+  void compile(std::string const& source, std::string const& name);
 };
 
 static_assert(std::move_constructible<ShaderStage>);
@@ -40,11 +79,17 @@ static_assert(std::assignable_from<ShaderStage&, ShaderStage&&>);
 
 class ShaderProgram {
 public:
-  ShaderProgram(std::initializer_list<ShaderStage> stages);
+  ShaderProgram(std::initializer_list<ShaderStage> stages):
+      ShaderProgram(std::span(stages.begin(), stages.size())) {}
+  explicit ShaderProgram(std::span<ShaderStage const> stages);
   ~ShaderProgram() noexcept;
 
+  // Loads a binary returned by `binary()`, or returns nothing if the driver rejects it.
+  static std::optional<ShaderProgram> fromBinary(GLenum format, std::vector<char> const& data);
+
   ShaderProgram(ShaderProgram&& r) noexcept:
-      mHandle(std::exchange(r.mHandle, OpenGL::null)) {}
+      mHandle(std::exchange(r.mHandle, OpenGL::null)),
+      mLocations(std::move(r.mLocations)) {}
 
   ShaderProgram& operator=(ShaderProgram&& r) noexcept {
     swap(*this, r);
@@ -54,9 +99,16 @@ public:
   friend void swap(ShaderProgram& l, ShaderProgram& r) noexcept {
     using std::swap;
     swap(l.mHandle, r.mHandle);
+    swap(l.mLocations, r.mLocations);
   }
 
   OpenGL::Object handle() const { return mHandle; }
+  bool linked() const;
+
+  // Returns the linked program binary and its format (empty if unsupported).
+  std::vector<char> binary(GLenum& format) const;
+
+  // Locations are resolved once at link time; unused names are logged on first use.
   OpenGL::UniformLocation uniformLocation(std::string const& name) const;
 
   // `-1`s in uniform locations are silently ignored.
@@ -71,6 +123,9 @@ public:
   void uniformImage(std::string const& name, GLint index) const  { glUniform1i(L(name), index); }
   void uniformImages(std::string const& name, size_t count, GLint const* indices) const  { glUniform1iv(L(name), count, indices); }
   void uniformFloat(std::string const& name, GLfloat x) const  { glUniform1f(L(name), x); }
+  void uniformIVec2(std::string const& name, GLint x, GLint y) const  { glUniform2i(L(name), x, y); }
+  void uniformUVec2(std::string const& name, GLuint x, GLuint y) const  { glUniform2ui(L(name), x, y); }
+  void uniformUVec2s(std::string const& name, size_t count, GLuint const* values) const  { glUniform2uiv(L(name), count, values); }
   void uniformVec2(std::string const& name, GLfloat x, GLfloat y) const  { glUniform2f(L(name), x, y); }
   void uniformVec3(std::string const& name, GLfloat x, GLfloat y, GLfloat z) const  { glUniform3f(L(name), x, y, z); }
   void uniformVec4(std::string const& name, GLfloat x, GLfloat y, GLfloat z, GLfloat w) const  { glUniform4f(L(name), x, y, z, w); }
@@ -82,6 +137,12 @@ public:
 
 private:
   OpenGL::Object mHandle = OpenGL::null;
+  mutable std::unordered_map<std::string, OpenGL::UniformLocation> mLocations;
+
+  // Takes ownership of a linked program.
+  explicit ShaderProgram(OpenGL::Object handle);
+
+  void cacheLocations();
 };
 
 static_assert(std::move_constructible<ShaderProgram>);
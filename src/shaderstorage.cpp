@@ -60,6 +60,19 @@ void ShaderStorage::download(size_t offset, size_t size, void* data) const {
   }
 }
 
+void ShaderStorage::copyTo(ShaderStorage& dst, size_t offset, size_t dstOffset, size_t size) const {
+  assert(offset + size <= mSize && dstOffset + size <= dst.mSize);
+  glBindBuffer(GL_COPY_READ_BUFFER, mHandle);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, dst.mHandle);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, dstOffset, size);
+}
+
+void ShaderStorage::fill(uint32_t value) {
+  assert(!persistent());
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, mHandle);
+  glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &value);
+}
+
 void ShaderStorage::flush(size_t offset, size_t size) {
   assert(persistent());
   glBindBuffer(GL_SHADER_STORAGE_BUFFER, mHandle);
@@ -71,3 +84,38 @@ void ShaderStorage::wait() {
   auto sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
   glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, std::numeric_limits<GLuint64>::max());
 }
+
+ReadbackRing::ReadbackRing(size_t size, size_t slots):
+    mStorage(size > 0 ? ShaderStorage(size * slots, true) : ShaderStorage()),
+    mSize(size),
+    mFences(slots, nullptr) {
+  assert(slots > 0);
+}
+
+ReadbackRing::~ReadbackRing() noexcept {
+  for (auto fence: mFences)
+    if (fence != nullptr)
+      glDeleteSync(fence);
+}
+
+bool ReadbackRing::copy(ShaderStorage const& src, size_t offset) {
+  if (mPending == mFences.size())
+    return false;
+  auto const slot = (mFirst + mPending) % mFences.size();
+  src.copyTo(mStorage, offset, slot * mSize, mSize);
+  glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+  mFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  mPending++;
+  return true;
+}
+
+bool ReadbackRing::poll(void* data) {
+  if (mPending == 0 || glClientWaitSync(mFences[mFirst], 0, 0) == GL_TIMEOUT_EXPIRED)
+    return false;
+  glDeleteSync(mFences[mFirst]);
+  mFences[mFirst] = nullptr;
+  mStorage.download(mFirst * mSize, mSize, data);
+  mFirst = (mFirst + 1) % mFences.size();
+  mPending--;
+  return true;
+}
@@ -3,6 +3,9 @@
 
 #include <cassert>
 #include <concepts>
+#include <cstdint>
+#include <optional>
+#include <vector>
 #include "shader.h"
 
 // A shader storage buffer that can optionally be persistently mapped.
@@ -43,6 +46,12 @@ public:
   // Downloads data, or copies data from persistently-mapped memory (does not wait).
   void download(size_t offset, size_t size, void* data) const;
 
+  // Copies a range into `dst` on the GPU.
+  void copyTo(ShaderStorage& dst, size_t offset, size_t dstOffset, size_t size) const;
+
+  // Sets every 32-bit word to `value` on the GPU. `this` must not be persistently mapped.
+  void fill(uint32_t value);
+
   // Flushes changes to GPU. `this` must be persistently mapped.
   void flush(size_t offset, size_t size);
 
@@ -58,4 +67,70 @@ private:
 static_assert(std::move_constructible<ShaderStorage>);
 static_assert(std::assignable_from<ShaderStorage&, ShaderStorage&&>);
 
+// Reads back ranges of shader storage buffers without stalling: each `copy()` goes to the next slot of a
+// persistently-mapped ring on the GPU and is fenced, and `poll()` returns the oldest copy once it has completed
+// (normally a few frames later). Copies are skipped while all slots are pending.
+class ReadbackRing {
+public:
+  ReadbackRing(size_t size = 0, size_t slots = 3);
+  ~ReadbackRing() noexcept;
+
+  ReadbackRing(ReadbackRing&& r) noexcept:
+      mStorage(std::move(r.mStorage)),
+      mSize(std::exchange(r.mSize, 0)),
+      mFences(std::move(r.mFences)),
+      mFirst(std::exchange(r.mFirst, 0)),
+      mPending(std::exchange(r.mPending, 0)) {}
+
+  ReadbackRing& operator=(ReadbackRing&& r) noexcept {
+    swap(*this, r);
+    return *this;
+  }
+
+  friend void swap(ReadbackRing& l, ReadbackRing& r) noexcept {
+    using std::swap;
+    swap(l.mStorage, r.mStorage);
+    swap(l.mSize, r.mSize);
+    swap(l.mFences, r.mFences);
+    swap(l.mFirst, r.mFirst);
+    swap(l.mPending, r.mPending);
+  }
+
+  size_t pending() const { return mPending; }
+
+  // Copies `size()` bytes at `offset` of `src` into the next slot. Returns false if all slots are pending.
+  // Shader writes must be made visible beforehand (`GL_BUFFER_UPDATE_BARRIER_BIT`).
+  bool copy(ShaderStorage const& src, size_t offset = 0);
+
+  // Copies the oldest slot into `data` if it has completed. Returns false if none has.
+  bool poll(void* data);
+
+  template <typename T>
+  std::optional<T> poll() {
+    assert(sizeof(T) == mSize);
+    auto res = T();
+    return poll(&res) ? std::optional<T>(res) : std::nullopt;
+  }
+
+  // Like `poll()`, but returns the most recent completed slot, discarding older ones.
+  template <typename T>
+  std::optional<T> latest() {
+    auto res = std::optional<T>();
+    while (auto curr = poll<T>())
+      res = curr;
+    return res;
+  }
+
+  size_t size() const { return mSize; }
+
+private:
+  ShaderStorage mStorage;
+  size_t mSize;
+  std::vector<GLsync> mFences; // Per slot, null if not pending.
+  size_t mFirst = 0, mPending = 0; // Oldest pending slot, number of pending slots.
+};
+
+static_assert(std::move_constructible<ReadbackRing>);
+static_assert(std::assignable_from<ReadbackRing&, ReadbackRing&&>);
+
 #endif // SHADERSTORAGE_H_
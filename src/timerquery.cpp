@@ -0,0 +1,22 @@
+#include "timerquery.h"
+
+TimerQuery::TimerQuery() {
+  glGenQueries(1, &mHandle);
+}
+
+TimerQuery::~TimerQuery() noexcept {
+  if (mHandle != OpenGL::null)
+    glDeleteQueries(1, &mHandle);
+}
+
+bool TimerQuery::available() const {
+  GLint res = GL_FALSE;
+  glGetQueryObjectiv(mHandle, GL_QUERY_RESULT_AVAILABLE, &res);
+  return res != GL_FALSE;
+}
+
+uint64_t TimerQuery::result() const {
+  GLuint64 res = 0;
+  glGetQueryObjectui64v(mHandle, GL_QUERY_RESULT, &res);
+  return res;
+}
@@ -0,0 +1,48 @@
+#ifndef TIMERQUERY_H_
+#define TIMERQUERY_H_
+
+#include <concepts>
+#include <cstdint>
+#include <utility>
+#include "opengl.h"
+
+// A `GL_TIME_ELAPSED` query object measuring GPU time between `begin()` and `end()`.
+// At most one timer query can be active at a time. Alternatively, `timestamp()` records the GPU time once all
+// previous commands have completed (which can be done while a timer query is active).
+class TimerQuery {
+public:
+  TimerQuery();
+  ~TimerQuery() noexcept;
+
+  TimerQuery(TimerQuery&& r) noexcept:
+      mHandle(std::exchange(r.mHandle, OpenGL::null)) {}
+
+  TimerQuery& operator=(TimerQuery&& r) noexcept {
+    swap(*this, r);
+    return *this;
+  }
+
+  friend void swap(TimerQuery& l, TimerQuery& r) noexcept {
+    using std::swap;
+    swap(l.mHandle, r.mHandle);
+  }
+
+  OpenGL::Object handle() const { return mHandle; }
+  void begin() const { glBeginQuery(GL_TIME_ELAPSED, mHandle); }
+  static void end() { glEndQuery(GL_TIME_ELAPSED); }
+  void timestamp() const { glQueryCounter(mHandle, GL_TIMESTAMP); }
+
+  // Returns whether the result can be read without waiting.
+  bool available() const;
+
+  // Returns elapsed time (or the timestamp) in nanoseconds, waiting for the GPU if necessary.
+  uint64_t result() const;
+
+private:
+  OpenGL::Object mHandle = OpenGL::null;
+};
+
+static_assert(std::move_constructible<TimerQuery>);
+static_assert(std::assignable_from<TimerQuery&, TimerQuery&&>);
+
+#endif // TIMERQUERY_H_
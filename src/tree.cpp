@@ -1,5 +1,9 @@
 #include "tree.h"
+#include <algorithm>
+#include <bit>
 #include <cassert>
+#include <cstdlib>
+#include <random>
 #include <sstream>
 #include <vector>
 #include "bitmap.h"
@@ -7,18 +11,62 @@
 #include "log.h"
 #include "worldgen.h"
 
-void Tree::generate() {
-  Log::info("Generating terrain height...");
+// Nodes per step when streaming (possibly file-backed) storage to or from the GPU.
+constexpr auto streamNodes = 1uz << 24;
+
+// Patch layout (see `Tree::Patch`).
+constexpr auto patchHeaderWords = 4uz, patchEntryWords = 5uz, patchMaxDepth = 21uz;
+
+namespace {
+  // Node data encoding of `main.csh` (`MAKE_INTERMEDIATE()`, `IS_LEAF()` and so on).
+  constexpr uint32_t makeIntermediate(uint32_t ind) { return (ind << 2) + 1; }
+  constexpr uint32_t makeLeaf(uint32_t data) { return (data << 2) + 3; }
+  constexpr uint32_t childPtr(uint32_t data) { return data >> 2; }
+  constexpr bool isInvalid(uint32_t data) { return data == 0; }
+  constexpr bool isLocked(uint32_t data) { return data == 1; }
+  constexpr bool isLeaf(uint32_t data) { return (data & 3) == 3; }
+
+  // Aborts if `count` nodes cannot all be addressed by child pointers. Past this point they would silently wrap
+  // around and alias other nodes.
+  void checkCapacity(size_t count, char const* what) {
+    if (count <= Tree::maxNodes)
+      return;
+    std::stringstream ss;
+    ss << what << " needs " << count << " nodes, exceeding the limit of " << Tree::maxNodes << ".";
+    Log::fatal(ss.str());
+    std::abort();
+  }
+
+  // See: https://xorshift.di.unimi.it/splitmix64.c
+  uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+  }
+}
+
+void Tree::generate(bool verbose) {
+  mVerbose = verbose;
+  if (mVerbose)
+    Log::info("Generating terrain height...");
   for (auto x = 0uz; x < mSize; x++) {
     for (auto z = 0uz; z < mSize; z++) {
-      auto dx = static_cast<double>(x), dz = static_cast<double>(z);
+      auto dx = static_cast<double>(mX0 + static_cast<int64_t>(x));
+      auto dz = static_cast<double>(mZ0 + static_cast<int64_t>(z));
       mHeightMap[x * mSize + z] = WorldGen::getHeight(dx, dz) + 64;
     }
   }
-  Log::info("Generating tree...");
+  if (mVerbose)
+    Log::info("Generating tree...");
+  // Nodes are appended in DFS order, so only the current path and the tail of the storage are written.
   mNodes.resize(1);
+  mHashed = false;
   mBlocksGenerated = 0;
   generateNode(0, 0, 0, 0, mSize);
+  mHeightMap.advise(0, mHeightMap.size(), MappedVector<int64_t>::Advice::dontNeed);
 }
 
 void Tree::upload(ShaderStorage& ssbo) {
@@ -27,19 +75,126 @@ void Tree::upload(ShaderStorage& ssbo) {
   assert(ssbo.size() >= uploadSize());
   uint32_t nodeCount = static_cast<uint32_t>(mNodes.size());
   ssbo.upload(0, sizeof(uint32_t), &nodeCount);
-  ssbo.upload(sizeof(uint32_t), mNodes.size() * sizeof(uint32_t), mNodes.data());
+  mNodes.advise(0, mNodes.size(), MappedVector<Node>::Advice::sequential);
+  for (auto i = 0uz; i < mNodes.size(); i += streamNodes) {
+    auto const count = std::min(streamNodes, mNodes.size() - i);
+    mNodes.advise(i + count, std::min(streamNodes, mNodes.size() - i - count), MappedVector<Node>::Advice::willNeed);
+    ssbo.upload((1 + i) * sizeof(uint32_t), count * sizeof(uint32_t), mNodes.data() + i);
+    mNodes.advise(i, count, MappedVector<Node>::Advice::dontNeed);
+  }
 
   std::stringstream ss;
   ss << nodeCount << " nodes uploaded.";
   Log::info(ss.str());
 }
 
+std::vector<uint32_t> Tree::exportNodes(uint32_t base) const {
+  checkCapacity(base + mNodes.size(), "Relocated tree");
+  auto res = std::vector<uint32_t>(mNodes.size());
+  for (auto i = 0uz; i < mNodes.size(); i++) {
+    auto const& node = mNodes[i];
+    auto data = (node.generated && !node.leaf) ? node.data + base : node.data;
+    res[i] = (data << 2) | (static_cast<uint32_t>(node.leaf) << 1) | static_cast<uint32_t>(node.generated);
+  }
+  return res;
+}
+
+std::vector<uint32_t> Tree::exportChildMasks() const {
+  auto const empty = [](Node const& node) { return !node.generated || (node.leaf && node.data == 0); };
+  auto res = std::vector<uint32_t>(childMaskRoot + 2, 0);
+  if (mNodes.empty() || empty(mNodes[0]))
+    return res;
+  if (mNodes[0].leaf) {
+    res[childMaskRoot] = 0xFFFF; // A solid root is equivalent to 8 solid children.
+    return res;
+  }
+  // Breadth-first, so that the children of each node are allocated together.
+  auto queue = std::vector<std::pair<size_t, size_t>>{{0, childMaskRoot}}; // Node index, descriptor offset.
+  for (auto front = 0uz; front < queue.size(); front++) {
+    auto const [ind, offset] = queue[front];
+    auto const first = static_cast<size_t>(mNodes[ind].data);
+    auto valid = 0u, leaf = 0u;
+    auto const ptr = res.size();
+    for (auto i = 0uz; i < 8; i++) {
+      auto const& child = mNodes[first + i];
+      if (empty(child))
+        continue;
+      valid |= 1u << i;
+      if (child.leaf) {
+        leaf |= 1u << i;
+      } else {
+        queue.emplace_back(first + i, res.size());
+        res.resize(res.size() + 2);
+      }
+    }
+    checkCapacity(res.size(), "Child-mask tree");
+    res[offset] = valid | leaf << 8;
+    res[offset + 1] = static_cast<uint32_t>(ptr);
+  }
+  return res;
+}
+
+bool Tree::checkChildMasks(std::vector<uint32_t> const& words) const {
+  // See `childData()` in `main.csh`. Descriptors out of range decode as invalid.
+  auto const childData = [&words](uint32_t data, uint32_t index) {
+    auto const desc = childPtr(data);
+    if (static_cast<size_t>(desc) + 1 >= words.size())
+      return 0u;
+    auto const masks = words[desc], bit = 1u << index;
+    if ((masks & bit) == 0)
+      return makeLeaf(0);
+    if ((masks & (bit << 8)) != 0)
+      return makeLeaf(1);
+    auto const inter = masks & ~(masks >> 8) & 0xFFu;
+    return makeIntermediate(words[desc + 1] + 2 * static_cast<uint32_t>(std::popcount(inter & (bit - 1))));
+  };
+  auto const empty = [](Node const& node) { return !node.generated || (node.leaf && node.data == 0); };
+  auto mismatches = 0uz;
+  // Node, its data as seen by the shader. The root is always a descriptor: a leaf root has 8 copies of itself.
+  auto stack = std::vector<std::pair<Node, uint32_t>>();
+  auto const root = mNodes.empty() ? Node{} : mNodes[0];
+  auto const rootData = makeIntermediate(childMaskRoot); // See `rootData()` in `main.csh`.
+  if (isInvalid(rootData) || isLocked(rootData))
+    mismatches++;
+  for (auto i = 0u; i < 8; i++) {
+    auto const& child = empty(root) || root.leaf ? root : mNodes[root.data + i];
+    stack.emplace_back(child, childData(rootData, i));
+  }
+  while (!stack.empty()) {
+    auto const [node, data] = stack.back();
+    stack.pop_back();
+    if (empty(node) || node.leaf) {
+      if (data != makeLeaf(empty(node) ? 0 : 1))
+        mismatches++;
+      continue;
+    }
+    if (isInvalid(data) || isLocked(data) || isLeaf(data)) {
+      mismatches++;
+      continue;
+    }
+    for (auto i = 0u; i < 8; i++)
+      stack.emplace_back(mNodes[node.data + i], childData(data, i));
+  }
+  if (mismatches > 0) {
+    std::stringstream ss;
+    ss << "Child-mask tree does not decode to the exported tree (" << mismatches << " mismatching nodes).";
+    Log::error(ss.str());
+  }
+  return mismatches == 0;
+}
+
 void Tree::download(ShaderStorage& ssbo) {
   Log::info("Downloading tree data...");
   uint32_t nodeCount = 0;
   ssbo.download(0, sizeof(uint32_t), &nodeCount);
-  mNodes.resize(nodeCount);
-  ssbo.download(sizeof(uint32_t), sizeof(uint32_t) * nodeCount, mNodes.data());
+  // Every node is overwritten below, one step at a time.
+  mNodes.resizeUninitialized(nodeCount);
+  mHashed = false;
+  for (auto i = 0uz; i < mNodes.size(); i += streamNodes) {
+    auto const count = std::min(streamNodes, mNodes.size() - i);
+    ssbo.download((1 + i) * sizeof(uint32_t), count * sizeof(uint32_t), mNodes.data() + i);
+    mNodes.advise(i, count, MappedVector<Node>::Advice::dontNeed);
+  }
   std::stringstream ss;
   ss << nodeCount << " nodes downloaded.";
   Log::info(ss.str());
@@ -68,6 +223,8 @@ int32_t Tree::dfs(size_t ind, size_t& count, size_t& redundant) {
 void Tree::check() {
   Log::info("Checking tree...");
   size_t count = 0, redundant = 0;
+  // Children are stored after their parents in DFS order, so the traversal mostly reads forward.
+  mNodes.advise(0, mNodes.size(), MappedVector<Node>::Advice::sequential);
   dfs(0, count, redundant);
   std::stringstream ss;
   ss.str("");
@@ -89,6 +246,7 @@ bool Tree::gcdfs(Node const& node, Node& other, Tree& res) {
   if (node.leaf)
     return true;
   // Allocate children for `other`.
+  checkCapacity(res.mNodes.size() + 8, "Tree");
   other.data = static_cast<uint32_t>(res.mNodes.size());
   res.mNodes.resize(other.data + 8);
   // Mid: `node` and `other` are intermediate.
@@ -111,7 +269,9 @@ bool Tree::gcdfs(Node const& node, Node& other, Tree& res) {
 void Tree::gc(Tree& res) {
   Log::info("Optimizing tree...");
   res.mNodes.reserve(mNodes.size());
+  res.mHashed = false;
   res.mNodes.push_back(Node());
+  mNodes.advise(0, mNodes.size(), MappedVector<Node>::Advice::sequential);
   gcdfs(mNodes[0], res.mNodes[0], res);
   // res.check();
 }
@@ -128,11 +288,11 @@ void Tree::generateNode(size_t ind, size_t x0, size_t y0, size_t z0, size_t size
     // auto sx0 = static_cast<int64_t>(x0), sy0 = static_cast<int64_t>(y0), sz0 = static_cast<int64_t>(z0);
     // double density = WorldGen::getDensity(dx0, dy0, dz0);
     // mNodes[ind].data = WorldGen::getBlock(sx0, sy0, sz0, mHeightMap[x0 * mSize + z0], density) ? 1 : 0;
-    mNodes[ind].data = static_cast<int64_t>(y0) < mHeightMap[x0 * mSize + z0] ? 1 : 0;
+    mNodes[ind].data = mY0 + static_cast<int64_t>(y0) < mHeightMap[x0 * mSize + z0] ? 1 : 0;
     mNodes[ind].leaf = true;
     // Count
     mBlocksGenerated++;
-    if (mBlocksGenerated % 10000000 == 0) {
+    if (mVerbose && mBlocksGenerated % 10000000 == 0) {
       size_t percent = mBlocksGenerated * 100 / (mSize * mSize * mHeight);
       std::stringstream ss;
       ss << mBlocksGenerated << " (" << percent << "%) blocks generated, ";
@@ -141,14 +301,14 @@ void Tree::generateNode(size_t ind, size_t x0, size_t y0, size_t z0, size_t size
     }
     return;
   }
-  if (y0 >= mHeight) {
+  if (mY0 + static_cast<int64_t>(y0) >= static_cast<int64_t>(mHeight)) {
     mNodes[ind].data = 0;
     mNodes[ind].leaf = true;
     return;
   }
   auto cptr = mNodes.size();
   auto half = size / 2;
-  assert(cptr < (1u << 30));
+  checkCapacity(cptr + 8, "Tree");
   mNodes[ind].data = static_cast<uint32_t>(cptr);
   mNodes[ind].leaf = false;
   mNodes.resize(cptr + 8);
@@ -176,3 +336,271 @@ void Tree::generateNode(size_t ind, size_t x0, size_t y0, size_t z0, size_t size
     }
   }
 }
+
+void Tree::set(size_t x, size_t y, size_t z, uint32_t data) {
+  assert(x < mSize && y < mSize && z < mSize && data < maxNodes);
+  auto path = std::vector<size_t>{0};
+  auto ind = 0uz;
+  for (auto half = mSize / 2; half > 0; half /= 2) {
+    auto const node = mNodes[ind];
+    if (node.leaf && node.data == data)
+      return;
+    if (!node.generated || node.leaf) {
+      // Split: children inherit the leaf (or stay ungenerated).
+      auto const cptr = mNodes.size();
+      checkCapacity(cptr + 8, "Tree");
+      mNodes.resize(cptr + 8);
+      for (auto i = cptr; i < cptr + 8; i++)
+        mNodes[i] = node;
+      mNodes[ind] = Node{.generated = true, .leaf = false, .data = static_cast<uint32_t>(cptr)};
+      if (mHashed) {
+        mHashes.resize(mNodes.size());
+        for (auto i = cptr; i < cptr + 8; i++)
+          mHashes[i] = nodeHash(i);
+      }
+    }
+    ind = mNodes[ind].data + ((x & half) ? 1 : 0) + ((y & half) ? 2 : 0) + ((z & half) ? 4 : 0);
+    path.push_back(ind);
+  }
+  mNodes[ind] = Node{.generated = true, .leaf = true, .data = data};
+  if (mHashed)
+    for (auto it = path.rbegin(); it != path.rend(); it++)
+      mHashes[*it] = nodeHash(*it);
+}
+
+// Pre: hashes of children are up to date.
+uint64_t Tree::nodeHash(size_t ind) const {
+  auto const& node = mNodes[ind];
+  if (!node.generated)
+    return mix(0);
+  if (node.leaf)
+    return mix((static_cast<uint64_t>(node.data) << 2) | 3);
+  auto res = uint64_t(1);
+  for (auto i = 0uz; i < 8; i++)
+    res = mix(res ^ mHashes[node.data + i]);
+  return res;
+}
+
+uint64_t Tree::rehash(size_t ind) const {
+  auto const& node = mNodes[ind];
+  if (node.generated && !node.leaf)
+    for (auto i = 0uz; i < 8; i++)
+      rehash(node.data + i);
+  return mHashes[ind] = nodeHash(ind);
+}
+
+uint64_t Tree::hash(size_t ind) const {
+  if (!mHashed) {
+    mHashes.resize(mNodes.size());
+    rehash(0);
+    mHashed = true;
+  }
+  return mHashes[ind];
+}
+
+// Appends descendants of `ind` to `patch`, returning the node with child pointer relative to `body`.
+uint32_t Tree::serialize(size_t ind, Patch& patch, size_t body) const {
+  auto node = mNodes[ind];
+  if (node.generated && !node.leaf) {
+    auto const cptr = patch.size();
+    patch.resize(cptr + 8);
+    for (auto i = 0uz; i < 8; i++) {
+      auto const child = serialize(node.data + i, patch, body);
+      patch[cptr + i] = child;
+    }
+    node.data = static_cast<uint32_t>(cptr - body);
+  }
+  return std::bit_cast<uint32_t>(node);
+}
+
+void Tree::diffNode(Tree const& curr, size_t ind, size_t currInd, size_t depth, uint64_t path, Patch& patch) const {
+  if (hash(ind) == curr.hash(currInd))
+    return;
+  auto const& node = mNodes[ind];
+  auto const& other = curr.mNodes[currInd];
+  if (node.generated && !node.leaf && other.generated && !other.leaf) {
+    assert(depth < patchMaxDepth);
+    for (auto i = 0uz; i < 8; i++)
+      diffNode(curr, node.data + i, other.data + i, depth + 1, path | (static_cast<uint64_t>(i) << (depth * 3)), patch);
+    return;
+  }
+  auto const entry = patch.size();
+  patch.resize(entry + patchEntryWords);
+  auto const root = curr.serialize(currInd, patch, entry + patchEntryWords);
+  patch[entry] = static_cast<uint32_t>(depth);
+  patch[entry + 1] = static_cast<uint32_t>(path);
+  patch[entry + 2] = static_cast<uint32_t>(path >> 32);
+  patch[entry + 3] = static_cast<uint32_t>(patch.size() - entry - patchEntryWords);
+  patch[entry + 4] = root;
+}
+
+Tree::Patch Tree::diff(Tree const& old, Tree const& curr) {
+  assert(old.mSize == curr.mSize);
+  auto res = Patch(patchHeaderWords);
+  auto const oldHash = old.hash(0), currHash = curr.hash(0);
+  res[0] = static_cast<uint32_t>(oldHash);
+  res[1] = static_cast<uint32_t>(oldHash >> 32);
+  res[2] = static_cast<uint32_t>(currHash);
+  res[3] = static_cast<uint32_t>(currHash >> 32);
+  old.diffNode(curr, 0, 0, 0, 0, res);
+  return res;
+}
+
+std::vector<Tree::Span> Tree::applyPatch(Patch const& patch) {
+  auto const word64 = [&patch](size_t i) { return patch[i] | static_cast<uint64_t>(patch[i + 1]) << 32; };
+  auto const isIntermediate = [](Node const& node) { return node.generated && !node.leaf; };
+
+  // Returns the node index at the path of an entry, or `mNodes.size()` if it does not exist.
+  auto const target = [&](size_t entry, std::vector<size_t>* path) {
+    auto ind = 0uz;
+    auto const bits = word64(entry + 1);
+    for (auto d = 0uz; d < patch[entry]; d++) {
+      if (!isIntermediate(mNodes[ind]) || static_cast<size_t>(mNodes[ind].data) + 8 > mNodes.size())
+        return mNodes.size();
+      ind = mNodes[ind].data + ((bits >> (d * 3)) & 7);
+      if (path)
+        path->push_back(ind);
+    }
+    return ind;
+  };
+
+  // Validate before modifying anything.
+  auto valid = patch.size() >= patchHeaderWords && word64(0) == hash(0);
+  auto appended = 0uz;
+  for (auto entry = patchHeaderWords; valid && entry < patch.size();) {
+    // The entry header must be complete before its node count is read.
+    if (entry + patchEntryWords > patch.size()) {
+      valid = false;
+      break;
+    }
+    auto const next = entry + patchEntryWords + patch[entry + 3];
+    valid = next <= patch.size() && patch[entry] <= patchMaxDepth && target(entry, nullptr) < mNodes.size();
+    appended += patch[entry + 3];
+    entry = next;
+  }
+  if (!valid) {
+    Log::error("Patch does not apply to this tree.");
+    return {};
+  }
+  if (mNodes.size() + appended > maxNodes) {
+    Log::error("Patch would exceed the node limit of this tree.");
+    return {};
+  }
+
+  auto spans = std::vector<Span>();
+  auto path = std::vector<size_t>();
+  for (auto entry = patchHeaderWords; entry < patch.size(); entry += patchEntryWords + patch[entry + 3]) {
+    path.assign(1, 0);
+    auto const ind = target(entry, &path);
+    auto const count = static_cast<size_t>(patch[entry + 3]);
+    auto const base = mNodes.size();
+    assert(base + count <= maxNodes);
+    auto const relocate = [base, isIntermediate](uint32_t word) {
+      auto node = std::bit_cast<Node>(word);
+      if (isIntermediate(node))
+        node.data += static_cast<uint32_t>(base);
+      return node;
+    };
+    mNodes.resize(base + count);
+    for (auto i = 0uz; i < count; i++)
+      mNodes[base + i] = relocate(patch[entry + patchEntryWords + i]);
+    mNodes[ind] = relocate(patch[entry + 4]);
+    if (mHashed) {
+      // Children are stored after their parents, so hash backwards.
+      mHashes.resize(mNodes.size());
+      for (auto i = count; i-- > 0;)
+        mHashes[base + i] = nodeHash(base + i);
+      for (auto it = path.rbegin(); it != path.rend(); it++)
+        mHashes[*it] = nodeHash(*it);
+    }
+    spans.push_back(Span{ind, 1});
+    if (count > 0)
+      spans.push_back(Span{base, count});
+  }
+  if (hash(0) != word64(2))
+    Log::warning("Patched tree does not match the expected hash.");
+
+  // Sort and merge.
+  std::ranges::sort(spans, {}, &Span::first);
+  auto res = std::vector<Span>();
+  for (auto const& span: spans) {
+    if (!res.empty() && res.back().first + res.back().count >= span.first)
+      res.back().count = std::max(res.back().count, span.first + span.count - res.back().first);
+    else
+      res.push_back(span);
+  }
+  return res;
+}
+
+void Tree::upload(ShaderStorage& ssbo, std::vector<Span> const& spans) {
+  assert(ssbo.size() >= uploadSize());
+  auto const nodeCount = static_cast<uint32_t>(mNodes.size());
+  ssbo.upload(0, sizeof(uint32_t), &nodeCount);
+  auto total = 0uz;
+  for (auto const& span: spans) {
+    assert(span.first + span.count <= mNodes.size());
+    ssbo.upload((1 + span.first) * sizeof(uint32_t), span.count * sizeof(uint32_t), mNodes.data() + span.first);
+    total += span.count;
+  }
+  std::stringstream ss;
+  ss << total << " of " << nodeCount << " nodes uploaded in " << spans.size() << " spans.";
+  Log::verbose(ss.str());
+}
+
+bool Tree::patchSelfTest(size_t levels, size_t edits) {
+  std::stringstream ss;
+  ss << "Testing tree patches (" << levels << " levels, " << edits << " edits)...";
+  Log::info(ss.str());
+
+  auto const size = 1uz << levels;
+  auto base = Tree(size, size), old = Tree(size, size), curr = Tree(size, size);
+  base.generate(false);
+  old.generate(false);
+  curr.generate(false);
+  auto rng = std::mt19937(2333);
+  for (auto i = 0uz; i < edits; i++)
+    curr.set(rng() % size, rng() % size, rng() % size, rng() % 16);
+
+  auto ok = true;
+  auto const patch = diff(old, curr);
+
+  // Patches truncated inside the first or the last entry must be rejected, leaving the tree untouched.
+  if (patch.size() > patchHeaderWords) {
+    for (auto const size: {patchHeaderWords + 2, patch.size() - 1}) {
+      auto const truncated = Patch(patch.begin(), patch.begin() + static_cast<std::ptrdiff_t>(size));
+      if (!old.applyPatch(truncated).empty() || old.hash(0) != base.hash(0)) {
+        ss.str("");
+        ss << "Patch truncated to " << size << " words was applied.";
+        Log::error(ss.str());
+        ok = false;
+      }
+    }
+  }
+  auto const spans = old.applyPatch(patch);
+  if (old.hash(0) != curr.hash(0)) {
+    Log::error("Patched tree does not hash equal to the edited one.");
+    ok = false;
+  }
+
+  // Span upload over the unedited nodes vs. full upload.
+  auto full = ShaderStorage(old.uploadSize()), partial = ShaderStorage(old.uploadSize());
+  old.upload(full);
+  base.upload(partial);
+  old.upload(partial, spans);
+  auto expected = std::vector<uint32_t>(old.mNodes.size() + 1), actual = std::vector<uint32_t>(expected.size());
+  full.download(0, expected.size() * sizeof(uint32_t), expected.data());
+  partial.download(0, actual.size() * sizeof(uint32_t), actual.data());
+  if (expected != actual) {
+    ss.str("");
+    ss << "Span upload differs from full upload at word ";
+    ss << std::ranges::mismatch(expected, actual).in1 - expected.begin() << ".";
+    Log::error(ss.str());
+    ok = false;
+  }
+
+  ss.str("");
+  ss << (ok ? "Passed: " : "Failed: ") << patch.size() << " patch words, " << spans.size() << " spans, ";
+  ss << old.mNodes.size() << " nodes.";
+  ok ? Log::info(ss.str()) : Log::error(ss.str());
+  return ok;
+}
@@ -2,7 +2,9 @@
 #define TREE_H_
 
 #include <cstdint>
+#include <string>
 #include <vector>
+#include "mappedbuffer.h"
 #include "shaderstorage.h"
 
 // TODO: arrange
@@ -14,27 +16,110 @@ public:
     uint32_t data: 30;
   };
 
-  Tree(size_t size, size_t height):
+  // Max nodes (or words) addressable by child pointers: node data has 30 bits, as the GPU encoding tags the lowest
+  // 2 bits (`MAKE_INTERMEDIATE(ind) = (ind << 2) + 1` in `main.csh`).
+  static constexpr size_t maxNodes = 1uz << 30;
+
+  // Descriptor index of the root in child-mask format (see `exportChildMasks()`).
+  static constexpr uint32_t childMaskRoot = 2;
+
+  // A range of nodes changed by `applyPatch()`.
+  struct Span {
+    size_t first, count;
+  };
+
+  // Serialised difference between two trees (see `diff()`), in 32-bit words:
+  //   [old root hash (2)] [new root hash (2)] entries...
+  // Each entry replaces the subtree at a path from the root:
+  //   [depth] [path (2), 3 bits per level] [count] [root] [count nodes, child pointers relative to the entry]
+  using Patch = std::vector<uint32_t>;
+
+  // `x0`, `y0` and `z0` offset the generated region (used by chunks and lazily generated subtrees).
+  Tree(size_t size, size_t height, int64_t x0 = 0, int64_t y0 = 0, int64_t z0 = 0):
+      mSize(size),
+      mHeight(height),
+      mX0(x0),
+      mY0(y0),
+      mZ0(z0) {
+    mHeightMap.resize(size * size);
+  }
+
+  // Keeps nodes and height map in sparse files at `storagePath` (if non-empty), so that the tree can exceed
+  // physical memory. The files are removed when the tree is destroyed.
+  Tree(size_t size, size_t height, std::string const& storagePath):
+      mNodes(storagePath.empty() ? MappedVector<Node>() : MappedVector<Node>(storagePath)),
       mSize(size),
       mHeight(height),
-      mHeightMap(size * size) {}
+      mX0(0),
+      mY0(0),
+      mZ0(0),
+      mHeightMap(storagePath.empty() ? MappedVector<int64_t>() : MappedVector<int64_t>(storagePath + ".height")),
+      mHashes(storagePath.empty() ? MappedVector<uint64_t>() : MappedVector<uint64_t>(storagePath + ".hash")) {
+    mHeightMap.resize(size * size);
+  }
 
   size_t size() { return mSize; }
-  void generate();
+  size_t nodeCount() { return mNodes.size(); }
+  MappedVector<Node> const& nodes() const { return mNodes; }
+  void generate(bool verbose = true);
   size_t uploadSize() { return (mNodes.size() + 1) * sizeof(uint32_t); };
   void upload(ShaderStorage& ssbo);
+  // Returns nodes in GPU format, with child pointers relocated to start at `base`.
+  std::vector<uint32_t> exportNodes(uint32_t base) const;
+  // Returns the tree in child-mask format: 2 words per intermediate node, `[valid mask | leaf mask << 8]` and a
+  // pointer to the descriptors of its intermediate children, which are stored contiguously in child order.
+  // Empty children take no space; solid leaves only take their mask bit (block data is not kept). The root is at
+  // `childMaskRoot`: words before it are reserved, as node data pointing to descriptor 0 would read as locked.
+  std::vector<uint32_t> exportChildMasks() const;
+  // Decodes `words` (from `exportChildMasks()`) with the node encoding of `main.csh`, and returns whether every
+  // node matches this tree.
+  bool checkChildMasks(std::vector<uint32_t> const& words) const;
   void download(ShaderStorage& ssbo);
   void check();
   void gc(Tree& res);
 
+  // Sets a single block, splitting leaves on the way. Subtree hashes are updated along the path.
+  void set(size_t x, size_t y, size_t z, uint32_t data);
+
+  // Returns content hash of the subtree at `ind`. Computed for the whole tree on first use, then maintained
+  // incrementally by `set()` and `applyPatch()`.
+  uint64_t hash(size_t ind) const;
+
+  // Returns a patch transforming `old` into a tree with the same content as `curr`. Only subtrees whose hashes
+  // differ are included, so the patch size is proportional to the edit rather than the world.
+  static Patch diff(Tree const& old, Tree const& curr);
+
+  // Applies a patch made against a tree with the same content as `this` (the layout may differ). Replaced
+  // subtrees are appended, leaving old nodes unreachable until the next `gc()`. Returns changed node spans,
+  // sorted and merged, for re-uploading with `upload(ssbo, spans)`. Returns nothing if the patch does not apply.
+  std::vector<Span> applyPatch(Patch const& patch);
+
+  // Uploads the node count and the given spans only. `ssbo` must be large enough to hold all nodes.
+  void upload(ShaderStorage& ssbo, std::vector<Span> const& spans);
+
+  // Round-trip self-check: edits a fresh tree with `set()`, diffs it against an unedited copy and patches the copy,
+  // which must then hash equal (truncated patches must be rejected). A span upload over the unedited nodes must
+  // also match a full upload. Requires a current OpenGL context. Returns whether all checks passed.
+  static bool patchSelfTest(size_t levels, size_t edits);
+
 private:
-  std::vector<Node> mNodes;
+  MappedVector<Node> mNodes;
   size_t mSize, mHeight, mBlocksGenerated;
-  std::vector<int64_t> mHeightMap;
+  int64_t mX0, mY0, mZ0;
+  bool mVerbose = true;
+  MappedVector<int64_t> mHeightMap;
+
+  // Subtree hashes, valid if `mHashed` (see `hash()`).
+  mutable MappedVector<uint64_t> mHashes;
+  mutable bool mHashed = false;
 
   void generateNode(size_t ind, size_t x0, size_t y0, size_t z0, size_t size);
   int32_t dfs(size_t ind, size_t& count, size_t& redundant);
   bool gcdfs(Node const& node, Node& other, Tree& res);
+  uint64_t nodeHash(size_t ind) const;
+  uint64_t rehash(size_t ind) const;
+  uint32_t serialize(size_t ind, Patch& patch, size_t entry) const;
+  void diffNode(Tree const& curr, size_t ind, size_t currInd, size_t depth, uint64_t path, Patch& patch) const;
 };
 
 #endif // TREE_H_
@@ -0,0 +1,70 @@
+#include "treestatistics.h"
+#include <algorithm>
+#include <cassert>
+#include <sstream>
+#include "log.h"
+
+TreeStatistics::TreeStatistics(ShaderProgram program, size_t capacity):
+    mProgram(std::move(program)),
+    mCapacity(std::max(capacity, 1uz)),
+    mFrontier(mCapacity * sizeof(uint32_t)),
+    mResult(sizeof(Result)),
+    mReadback(sizeof(Result), 1) {}
+
+void TreeStatistics::run(size_t levels) {
+  assert(levels < maxLevels);
+  if (pending())
+    return;
+  auto init = Result();
+  init.count[0] = 1; // Root.
+  mResult.upload(0, sizeof(Result), &init);
+  mFrontier.bindAt(frontierBufferIndex);
+  mResult.bindAt(resultBufferIndex);
+
+  mProgram.use();
+  mProgram.uniformUInt("MaxLevels", static_cast<GLuint>(levels));
+  mProgram.uniformUInt("Capacity", static_cast<GLuint>(mCapacity));
+  // Children are appended by the previous level, and reduced before their parents.
+  mProgram.uniformBool("Reduce", false);
+  for (auto level = 0uz; level <= levels; level++) {
+    mProgram.uniformUInt("Level", static_cast<GLuint>(level));
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glDispatchCompute(workgroups, 1, 1);
+  }
+  mProgram.uniformBool("Reduce", true);
+  for (auto level = levels; level-- > 0;) {
+    mProgram.uniformUInt("Level", static_cast<GLuint>(level));
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glDispatchCompute(workgroups, 1, 1);
+  }
+
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  mReadback.copy(mResult);
+}
+
+std::optional<TreeStatistics::Result> TreeStatistics::poll() {
+  return mReadback.poll<Result>();
+}
+
+void TreeStatistics::log(Result const& result) {
+  auto reachable = 0uz, redundant = 0uz;
+  auto ss = std::stringstream();
+  ss << "Nodes per level (reachable, redundant):";
+  for (auto level = 0uz; level < maxLevels && result.count[level] > 0; level++) {
+    reachable += result.count[level];
+    redundant += result.redundant[level];
+    ss << "\n  " << level << ": " << result.count[level] << ", " << result.redundant[level];
+  }
+  Log::info(ss.str());
+  ss.str("");
+  ss << "Allocated nodes: " << result.allocated;
+  Log::info(ss.str());
+  ss.str("");
+  ss << "Reachable nodes: " << reachable;
+  Log::info(ss.str());
+  ss.str("");
+  ss << "Redundant nodes: " << redundant << " (" << redundant * 100 / std::max(reachable, 1uz) << "%)";
+  Log::info(ss.str());
+  if (result.truncated > 0)
+    Log::warning("Tree statistics are partial: " + std::to_string(result.truncated) + " nodes not expanded.");
+}
@@ -0,0 +1,78 @@
+#ifndef TREESTATISTICS_H_
+#define TREESTATISTICS_H_
+
+#include <array>
+#include <concepts>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include "shader.h"
+#include "shaderstorage.h"
+
+// Reachable, redundant and per-level node counts of the tree bound to `TreeData` (as `Tree::check()`), computed on
+// the GPU by `treestats.csh` one level at a time. Only the small result is read back (through a `ReadbackRing`), so
+// that a check can run every few seconds without stalling.
+class TreeStatistics {
+public:
+  static constexpr auto maxLevels = 32uz; // Must match `MAX_TREE_LEVELS` in `treestats.csh`.
+
+  // `ResultData` in `treestats.csh`.
+  struct Result {
+    uint32_t allocated;
+    uint32_t truncated;
+    std::array<uint32_t, maxLevels> count;
+    std::array<uint32_t, maxLevels> redundant;
+  };
+
+  // `capacity` is the number of nodes that can be reached (4 bytes each).
+  TreeStatistics(ShaderProgram program, size_t capacity);
+
+  TreeStatistics(TreeStatistics&& r) noexcept:
+      mProgram(std::move(r.mProgram)),
+      mCapacity(r.mCapacity),
+      mFrontier(std::move(r.mFrontier)),
+      mResult(std::move(r.mResult)),
+      mReadback(std::move(r.mReadback)) {}
+
+  TreeStatistics& operator=(TreeStatistics&& r) noexcept {
+    swap(*this, r);
+    return *this;
+  }
+
+  friend void swap(TreeStatistics& l, TreeStatistics& r) noexcept {
+    using std::swap;
+    swap(l.mProgram, r.mProgram);
+    swap(l.mCapacity, r.mCapacity);
+    swap(l.mFrontier, r.mFrontier);
+    swap(l.mResult, r.mResult);
+    swap(l.mReadback, r.mReadback);
+  }
+
+  // Whether a check has been issued and not yet returned by `poll()`.
+  bool pending() const { return mReadback.pending() > 0; }
+
+  // Issues a check of a tree with `levels` levels below the root. Ignored while another one is pending.
+  void run(size_t levels);
+
+  // Returns the result of the pending check once it has completed.
+  std::optional<Result> poll();
+
+  // Logs a result in the format of `Tree::check()`, with per-level counts.
+  static void log(Result const& result);
+
+private:
+  static constexpr auto frontierBufferIndex = 11, resultBufferIndex = 12; // Must match `treestats.csh`.
+  static constexpr auto workgroups = 256uz;
+
+  ShaderProgram mProgram;
+  size_t mCapacity;
+  ShaderStorage mFrontier, mResult;
+  ReadbackRing mReadback;
+};
+
+static_assert(std::is_trivially_copyable_v<TreeStatistics::Result>);
+static_assert(std::move_constructible<TreeStatistics>);
+static_assert(std::assignable_from<TreeStatistics&, TreeStatistics&&>);
+
+#endif // TREESTATISTICS_H_
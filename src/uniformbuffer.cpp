@@ -0,0 +1,48 @@
+#include "uniformbuffer.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+UniformBuffer::UniformBuffer(size_t blockSize, size_t slots):
+    mBlockSize(blockSize),
+    mFences(slots, nullptr) {
+  assert(slots > 0);
+  auto alignment = GLint(0);
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  auto const align = static_cast<size_t>(std::max(alignment, 1));
+  mStride = (std::max(blockSize, 1uz) - 1) / align * align + align;
+
+  GLenum flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  glGenBuffers(1, &mHandle);
+  glBindBuffer(GL_UNIFORM_BUFFER, mHandle);
+  glBufferStorage(GL_UNIFORM_BUFFER, mStride * slots, nullptr, flags);
+  mPtr = glMapBufferRange(GL_UNIFORM_BUFFER, 0, mStride * slots, flags);
+}
+
+UniformBuffer::~UniformBuffer() noexcept {
+  for (auto fence: mFences)
+    if (fence != nullptr)
+      glDeleteSync(fence);
+  if (mHandle != OpenGL::null)
+    glDeleteBuffers(1, &mHandle);
+}
+
+void UniformBuffer::push(size_t index, void const* data) {
+  assert(mPtr != nullptr);
+  // Commands issued since the current slot was bound may read it.
+  if (mFences[mCurr] != nullptr)
+    glDeleteSync(mFences[mCurr]);
+  mFences[mCurr] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  // Wait until the GPU is done with the next slot (normally long since done).
+  mCurr = (mCurr + 1) % mFences.size();
+  if (mFences[mCurr] != nullptr) {
+    glClientWaitSync(mFences[mCurr], GL_SYNC_FLUSH_COMMANDS_BIT, std::numeric_limits<GLuint64>::max());
+    glDeleteSync(mFences[mCurr]);
+    mFences[mCurr] = nullptr;
+  }
+
+  auto const offset = mCurr * mStride;
+  std::memcpy(static_cast<char*>(mPtr) + offset, data, mBlockSize);
+  glBindBufferRange(GL_UNIFORM_BUFFER, static_cast<GLuint>(index), mHandle, offset, mBlockSize);
+}
@@ -0,0 +1,66 @@
+#ifndef UNIFORMBUFFER_H_
+#define UNIFORMBUFFER_H_
+
+#include <cassert>
+#include <concepts>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "opengl.h"
+
+// A ring of uniform block slots in persistently-mapped, coherent memory. Each `push()` writes the next slot and
+// binds it, so that the CPU never overwrites a block that the GPU may still be reading (guarded by a fence per slot).
+class UniformBuffer {
+public:
+  UniformBuffer(size_t blockSize = 0, size_t slots = 3);
+  ~UniformBuffer() noexcept;
+
+  UniformBuffer(UniformBuffer&& r) noexcept:
+      mHandle(std::exchange(r.mHandle, OpenGL::null)),
+      mPtr(std::exchange(r.mPtr, nullptr)),
+      mBlockSize(std::exchange(r.mBlockSize, 0)),
+      mStride(std::exchange(r.mStride, 0)),
+      mCurr(std::exchange(r.mCurr, 0)),
+      mFences(std::move(r.mFences)) {}
+
+  UniformBuffer& operator=(UniformBuffer&& r) noexcept {
+    swap(*this, r);
+    return *this;
+  }
+
+  friend void swap(UniformBuffer& l, UniformBuffer& r) noexcept {
+    using std::swap;
+    swap(l.mHandle, r.mHandle);
+    swap(l.mPtr, r.mPtr);
+    swap(l.mBlockSize, r.mBlockSize);
+    swap(l.mStride, r.mStride);
+    swap(l.mCurr, r.mCurr);
+    swap(l.mFences, r.mFences);
+  }
+
+  OpenGL::Object handle() const { return mHandle; }
+  size_t blockSize() const { return mBlockSize; }
+
+  // Writes `blockSize()` bytes to the next slot and binds it at uniform block binding `index`.
+  void push(size_t index, void const* data);
+
+  template <typename T>
+  requires std::is_trivially_copyable_v<T>
+  void push(size_t index, T const& data) {
+    assert(sizeof(T) == mBlockSize);
+    push(index, static_cast<void const*>(&data));
+  }
+
+private:
+  OpenGL::Object mHandle = OpenGL::null;
+  void* mPtr = nullptr;
+  size_t mBlockSize = 0;
+  size_t mStride = 0; // Block size rounded up to `GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT`.
+  size_t mCurr = 0;
+  std::vector<GLsync> mFences; // Per slot, null if unused.
+};
+
+static_assert(std::move_constructible<UniformBuffer>);
+static_assert(std::assignable_from<UniformBuffer&, UniformBuffer&&>);
+
+#endif // UNIFORMBUFFER_H_
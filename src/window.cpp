@@ -99,11 +99,33 @@ Window::Window(
 }
 
 Window::~Window() {
+  for (auto window: mSharedWindows)
+    SDL_DestroyWindow(window);
   SDL_DestroyWindow(mWindow);
   SDL_GL_DeleteContext(mContext);
   SDL_Quit();
 }
 
+std::optional<Window::SharedContext> Window::createSharedContext() const {
+  auto const window = SDL_CreateWindow("", 0, 0, 1, 1, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+  if (!window) {
+    Log::warning("Failed to create window for shared OpenGL context.");
+    return std::nullopt;
+  }
+  makeCurrent();
+  SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+  auto const context = SDL_GL_CreateContext(window);
+  SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+  makeCurrent();
+  if (!context) {
+    Log::warning("Failed to create shared OpenGL context.");
+    SDL_DestroyWindow(window);
+    return std::nullopt;
+  }
+  mSharedWindows.push_back(window);
+  return SharedContext{window, context};
+}
+
 void Window::pollEvents() {
   // Update mouse state.
   // Relative mode: motion = mMouse.xy, position = [not available]
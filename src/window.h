@@ -5,6 +5,7 @@
 #include <concepts>
 #include <optional>
 #include <string>
+#include <vector>
 #include <SDL2/SDL.h>
 #include "opengl.h"
 
@@ -61,6 +62,17 @@ public:
   }
 
   void makeCurrent() const { SDL_GL_MakeCurrent(mWindow, mContext); }
+
+  // A context sharing objects with the main one, with its own hidden 1x1 drawable, so that it can be made current
+  // on another thread while the main window is current (EGL forbids binding one surface in two threads).
+  struct SharedContext {
+    SDL_Window* window;
+    SDL_GLContext context;
+  };
+
+  // Returns nothing on failure. Must be called on the main thread; the drawable lives as long as `this`, and the
+  // context is deleted by its user (`SDL_GL_DeleteContext()`, once no longer current).
+  std::optional<SharedContext> createSharedContext() const;
   void swapBuffers() const { SDL_GL_SwapWindow(mWindow); }
   void pollEvents();
 
@@ -82,6 +94,7 @@ public:
 private:
   SDL_Window* mWindow = nullptr;
   SDL_GLContext mContext;
+  mutable std::vector<SDL_Window*> mSharedWindows; // Hidden drawables of shared contexts.
   std::optional<OpenGL> mGL; // late
 
   std::string mTitle;